@@ -0,0 +1,225 @@
+// BatchUpload.cpp
+#include <WiFiS3.h>
+
+#include "BatchUpload.h"
+#include "HangDetector.h"
+
+// --- 1. CONFIG ------------------------------------------------------
+
+// Ingester host for the HTTP fallback: uncomment and set to the LAN IP of
+// the machine running firebase_ingester.py (port CIRCUIT5_BATCH_PORT,
+// listening on CIRCUIT5_BATCH_BIND), and the token it was started with
+// (CIRCUIT5_BATCH_TOKEN).
+// #define CIRCUIT5_BATCH_UPLOAD_HOST "192.168.1.50"
+// #define CIRCUIT5_BATCH_UPLOAD_TOKEN "change-me"
+
+#ifdef CIRCUIT5_BATCH_UPLOAD_HOST
+
+#ifndef CIRCUIT5_BATCH_UPLOAD_TOKEN
+#error "CIRCUIT5_BATCH_UPLOAD_HOST needs CIRCUIT5_BATCH_UPLOAD_TOKEN (the ingester's CIRCUIT5_BATCH_TOKEN)"
+#endif
+
+static const uint16_t UPLOAD_PORT   = 8088;
+static const char     UPLOAD_PATH[] = "/ingest/circuit5/living-room/uno-r4";
+static const char     DEVICE_ID[]   = "uno-r4-living-room";
+
+static const uint16_t SAMPLE_SLOTS      = 512;   // ~25 min at one reading per 3 s (6 KB)
+static const uint16_t SAMPLES_PER_POST  = 120;   // bounds the time one upload blocks loop()
+static const uint8_t  SAMPLES_PER_CHUNK = 20;
+static const size_t   MAX_LINE          = 40;    // "<seq>,<age>,-40.00,100.00,n\n"
+
+static const uint32_t RESPONSE_TIMEOUT_MS = 5000;
+static const uint32_t RETRY_MIN_MS        = 5000;
+static const uint32_t RETRY_MAX_MS        = 120000;
+
+// --- 2. STATE -------------------------------------------------------
+
+// Compact copy of a reading: values in hundredths, as the telemetry JSON
+// sends them (two decimals)
+struct BufferedSample {
+  uint32_t sampledAt;   // millis() when taken; sent as an age
+  int16_t  centiTemp;
+  uint16_t centiHum;
+  char     status;      // n/a/e/u, the ingester's status codes
+};
+
+static BufferedSample gSamples[SAMPLE_SLOTS];
+static uint16_t gHead    = 0;
+static uint16_t gCount   = 0;
+static uint32_t gHeadSeq = 1;   // sequence number of gSamples[gHead]
+static uint32_t gBootId  = 0;   // sequence numbers restart with every boot
+static uint32_t gDropped = 0;
+
+static uint32_t gNextAttemptAt = 0;
+static uint32_t gRetryMs       = RETRY_MIN_MS;
+
+static WiFiClient gUploadClient;
+static char       gChunk[SAMPLES_PER_CHUNK * MAX_LINE];
+
+// Forward declarations of internal helpers
+static bool   uploadBatch();
+static long   readAck();
+static void   dropUpTo(uint32_t seq);
+static size_t formatSample(char *out, size_t room, uint32_t seq, uint32_t ageMs, const BufferedSample &s);
+static int    formatCenti(char *out, size_t room, int32_t centi);
+
+// --- 3. PUBLIC API IMPLEMENTATIONS ----------------------------------
+
+void batchUploadBuffer(float temperature, float humidity, const String &status) {
+  if (gBootId == 0) {
+    // No RTC or stored counter: Wi-Fi timing and a floating pin differ per boot
+    randomSeed(micros() ^ ((uint32_t)analogRead(A0) << 16));
+    gBootId = (uint32_t)random(1, 0x7FFFFFFF);
+  }
+
+  if (gCount == SAMPLE_SLOTS) {
+    dropUpTo(gHeadSeq);  // oldest first
+    gDropped++;
+  }
+
+  BufferedSample &s = gSamples[(gHead + gCount) % SAMPLE_SLOTS];
+  s.sampledAt = millis();
+  s.centiTemp = (int16_t)(temperature * 100.0f + (temperature < 0 ? -0.5f : 0.5f));
+  s.centiHum  = (uint16_t)(humidity * 100.0f + 0.5f);
+  s.status    = status == "normal" ? 'n' : status == "alert" ? 'a' : status == "error" ? 'e' : 'u';
+  gCount++;
+}
+
+void batchUploadLoop() {
+  if (gCount == 0 || (int32_t)(millis() - gNextAttemptAt) < 0 || WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+
+  HangScope hang(HANG_SITE_BATCH_UPLOAD);
+  if (uploadBatch()) {
+    gRetryMs = RETRY_MIN_MS;
+    gNextAttemptAt = millis();   // more waiting: next batch on the next loop()
+  } else {
+    gNextAttemptAt = millis() + gRetryMs;
+    gRetryMs = min(gRetryMs * 2, RETRY_MAX_MS);
+  }
+}
+
+uint16_t batchUploadPending() {
+  return gCount;
+}
+
+// --- 4. INTERNAL HELPERS --------------------------------------------
+
+// One POST of up to SAMPLES_PER_POST readings, oldest first, as chunks of
+// CSV lines. The ingester skips sequence numbers it already has, so a
+// batch cut off half way is simply sent again from the returned ack.
+static bool uploadBatch() {
+  if (!gUploadClient.connect(CIRCUIT5_BATCH_UPLOAD_HOST, UPLOAD_PORT)) {
+    Serial.println("UPLOAD: ingester not reachable, will retry.");
+    return false;
+  }
+
+  char bootHex[9];
+  snprintf(bootHex, sizeof(bootHex), "%08lx", (unsigned long)gBootId);
+
+  gUploadClient.print("POST ");
+  gUploadClient.print(UPLOAD_PATH);
+  gUploadClient.print(" HTTP/1.1\r\nHost: ");
+  gUploadClient.print(CIRCUIT5_BATCH_UPLOAD_HOST);
+  gUploadClient.print("\r\nAuthorization: Bearer ");
+  gUploadClient.print(CIRCUIT5_BATCH_UPLOAD_TOKEN);
+  gUploadClient.print("\r\nX-Device-Id: ");
+  gUploadClient.print(DEVICE_ID);
+  gUploadClient.print("\r\nX-Boot-Id: ");
+  gUploadClient.print(bootHex);
+  gUploadClient.print("\r\nContent-Type: text/csv\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n");
+
+  uint16_t n   = gCount < SAMPLES_PER_POST ? gCount : SAMPLES_PER_POST;
+  uint32_t now = millis();
+  for (uint16_t i = 0; i < n;) {
+    size_t len = 0;
+    for (uint8_t k = 0; k < SAMPLES_PER_CHUNK && i < n; k++, i++) {
+      const BufferedSample &s = gSamples[(gHead + i) % SAMPLE_SLOTS];
+      len += formatSample(gChunk + len, sizeof(gChunk) - len, gHeadSeq + i, now - s.sampledAt, s);
+    }
+
+    char size[12];
+    snprintf(size, sizeof(size), "%x\r\n", (unsigned)len);
+    gUploadClient.print(size);
+    gUploadClient.write((const uint8_t *)gChunk, len);
+    gUploadClient.print("\r\n");
+    if (!gUploadClient.connected()) {
+      Serial.println("UPLOAD: connection lost mid-batch, will resume.");
+      gUploadClient.stop();
+      return false;
+    }
+  }
+  gUploadClient.print("0\r\n\r\n");
+
+  long ack = readAck();
+  gUploadClient.stop();
+  if (ack < 0) {
+    Serial.println("UPLOAD: no ack from ingester, will resume.");
+    return false;
+  }
+
+  dropUpTo((uint32_t)ack);
+  Serial.print("UPLOAD: ingester acked up to #");
+  Serial.print(ack);
+  Serial.print(", ");
+  Serial.print(gCount);
+  Serial.print(" waiting, ");
+  Serial.print(gDropped);
+  Serial.println(" dropped (buffer full)");
+  return true;
+}
+
+// Parse {"boot": "...", "ack": N} from a 200 response; -1 otherwise
+static long readAck() {
+  gUploadClient.setTimeout(RESPONSE_TIMEOUT_MS);
+  String statusLine = gUploadClient.readStringUntil('\n');
+  if (statusLine.indexOf(" 200 ") < 0) {
+    return -1;
+  }
+  if (!gUploadClient.find("\r\n\r\n") || !gUploadClient.find("\"ack\":")) {
+    return -1;
+  }
+  return gUploadClient.parseInt();
+}
+
+static void dropUpTo(uint32_t seq) {
+  while (gCount > 0 && gHeadSeq <= seq) {
+    gHead = (gHead + 1) % SAMPLE_SLOTS;
+    gHeadSeq++;
+    gCount--;
+  }
+}
+
+// "<seq>,<age ms>,<temperature>,<humidity>,<status>\n"
+static size_t formatSample(char *out, size_t room, uint32_t seq, uint32_t ageMs, const BufferedSample &s) {
+  int len = snprintf(out, room, "%lu,%lu,", (unsigned long)seq, (unsigned long)ageMs);
+  len += formatCenti(out + len, room - len, s.centiTemp);
+  out[len++] = ',';
+  len += formatCenti(out + len, room - len, s.centiHum);
+  len += snprintf(out + len, room - len, ",%c\n", s.status);
+  return (size_t)len;
+}
+
+// Hundredths as "-12.34" without pulling in float printf
+static int formatCenti(char *out, size_t room, int32_t centi) {
+  const char *sign = centi < 0 ? "-" : "";
+  if (centi < 0) centi = -centi;
+  return snprintf(out, room, "%s%ld.%02ld", sign, (long)(centi / 100), (long)(centi % 100));
+}
+
+#else
+
+void batchUploadBuffer(float temperature, float humidity, const String &status) {
+  (void)temperature;
+  (void)humidity;
+  (void)status;
+}
+
+void batchUploadLoop() {}
+
+uint16_t batchUploadPending() {
+  return 0;
+}
+
+#endif
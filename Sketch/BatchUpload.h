@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Arduino.h>
+
+// HTTP batch-upload fallback, enabled by CIRCUIT5_BATCH_UPLOAD_HOST in
+// BatchUpload.cpp (all calls are no-ops without it).
+// Readings that could not be published over MQTT are kept in a RAM ring
+// buffer and POSTed to the ingester (firebase_ingester.py, section 8) in
+// chunked batches. Each reading carries a sequence number; the ingester
+// replies with the last one written to the database and the next batch
+// resumes after it (readings it already has are skipped, not duplicated).
+
+// Keep a reading that could not be published. When the buffer is full the
+// oldest reading is dropped.
+void batchUploadBuffer(float temperature, float humidity, const String &status);
+
+// Call once per loop(): uploads one batch when readings are waiting and the
+// retry back-off has passed.
+void batchUploadLoop();
+
+// Readings waiting to be uploaded.
+uint16_t batchUploadPending();
@@ -0,0 +1,151 @@
+// HangDetector.cpp
+#include <WDT.h>
+#include <FspTimer.h>
+
+#include "HangDetector.h"
+
+// --- 1. CONFIG ------------------------------------------------------
+//
+// The RA4M1 watchdog tops out at ~5.5 s, shorter than a legitimate Wi-Fi or
+// MQTT connect. So the hardware watchdog is fed from a periodic timer
+// interrupt, and only while the current site is within its budget below.
+// If the main context stalls past the budget (or interrupts are disabled),
+// feeding stops and the hardware resets the board.
+
+static const uint32_t WDT_TIMEOUT_MS = 5000;
+static const float    SUPERVISOR_HZ  = 4.0f;        // budget checks per second
+static const uint32_t HANG_MAGIC     = 0x48414E47;  // "HANG"
+
+// Longest time each site may run before it counts as hung
+static const uint32_t SITE_BUDGET_MS[HANG_SITE_COUNT] = {
+  10000,  // NONE (setup before the first site)
+  10000,  // LOOP
+  30000,  // WIFI_CONNECT   - called with a 20 s timeout
+  75000,  // MQTT_CONNECT   - up to 5 attempts with 2 s back-off
+  5000,   // MQTT_POLL
+  10000,  // MQTT_PUBLISH
+  2000,   // DHT_READ
+  5000,   // CONFIG_PORTAL  - re-entered every accept-loop iteration
+  10000,  // CONFIG_CLIENT  - 5 s read window + response
+  20000,  // BATCH_UPLOAD   - connect + one batch + 5 s response window
+};
+
+// Names used in the published report
+static const char *const SITE_NAMES[HANG_SITE_COUNT] = {
+  "none",
+  "loop",
+  "connectWithStoredCredentials",
+  "connectToMqttBroker",
+  "mqttPoll",
+  "mqttPublishTelemetry",
+  "dhtRead",
+  "runProvisioningPortal",
+  "handleConfigClient",
+  "batchUploadLoop",
+};
+
+// --- 2. STATE -------------------------------------------------------
+
+// Not zeroed by the startup code, so it survives a watchdog reset
+HangRecord gHangRecord __attribute__((section(".noinit")));
+
+static FspTimer gSupervisorTimer;
+
+// Forward declarations of internal helpers
+static uint32_t reportChecksum();
+static void     supervisorTick(timer_callback_args_t *args);
+
+// --- 3. PUBLIC API IMPLEMENTATIONS ----------------------------------
+
+void hangDetectorBegin() {
+  bool watchdogReset = R_SYSTEM->RSTSR1_b.WDTRF;
+  if (watchdogReset) {
+    R_SYSTEM->RSTSR1_b.WDTRF = 0;  // flag is cleared by writing 0 after reading 1
+  }
+
+  if (gHangRecord.magic != HANG_MAGIC || gHangRecord.reportCheck != reportChecksum()) {
+    // Power-on (RAM holds garbage) or a corrupted record: start clean
+    memset((void *)&gHangRecord, 0, sizeof(gHangRecord));
+    gHangRecord.magic = HANG_MAGIC;
+  } else if (watchdogReset) {
+    // The board was reset roughly WDT_TIMEOUT_MS after the last refresh
+    uint8_t site = gHangRecord.site < HANG_SITE_COUNT ? gHangRecord.site : HANG_SITE_NONE;
+    int32_t stalled = (int32_t)(gHangRecord.lastRefreshAt + WDT_TIMEOUT_MS - gHangRecord.enteredAt);
+
+    gHangRecord.reportSite      = site;
+    gHangRecord.reportStalledMs = stalled > 0 ? (uint32_t)stalled : 0;
+    gHangRecord.resetCount++;
+    gHangRecord.reportPending   = true;
+
+    Serial.print("HANG: watchdog reset, stalled in ");
+    Serial.print(SITE_NAMES[site]);
+    Serial.print(" for ~");
+    Serial.print(gHangRecord.reportStalledMs);
+    Serial.println(" ms");
+  }
+  gHangRecord.reportCheck = reportChecksum();
+
+  // Fresh breadcrumb for this boot
+  gHangRecord.lastRefreshAt = millis();
+  hangEnter(HANG_SITE_NONE);
+
+  // Supervisor timer first: without it the watchdog would never be fed
+  uint8_t timerType = GPT_TIMER;
+  int8_t  channel   = FspTimer::get_available_timer(timerType);
+  if (channel < 0 ||
+      !gSupervisorTimer.begin(TIMER_MODE_PERIODIC, timerType, channel, SUPERVISOR_HZ, 0.0f, supervisorTick) ||
+      !gSupervisorTimer.setup_overflow_irq() ||
+      !gSupervisorTimer.open() ||
+      !gSupervisorTimer.start()) {
+    Serial.println("HANG: no timer available, hang detector disabled.");
+    return;
+  }
+
+  if (!WDT.begin(WDT_TIMEOUT_MS)) {
+    Serial.println("HANG: watchdog start failed, hang detector disabled.");
+    return;
+  }
+  Serial.println("HANG: hang detector armed.");
+}
+
+bool hangDetectorPendingReport(String &out) {
+  if (!gHangRecord.reportPending) return false;
+
+  out  = "{\"event\":\"watchdogReset\",\"site\":\"";
+  out += SITE_NAMES[gHangRecord.reportSite];
+  out += "\",\"stalledMs\":";
+  out += gHangRecord.reportStalledMs;
+  out += ",\"resetCount\":";
+  out += gHangRecord.resetCount;
+  out += "}";
+  return true;
+}
+
+void hangDetectorReportSent() {
+  gHangRecord.reportPending = false;
+  gHangRecord.reportCheck   = reportChecksum();
+}
+
+// --- 4. INTERNAL HELPERS --------------------------------------------
+
+static uint32_t reportChecksum() {
+  uint32_t h = gHangRecord.magic;
+  h = (h * 31) ^ gHangRecord.reportSite;
+  h = (h * 31) ^ gHangRecord.reportStalledMs;
+  h = (h * 31) ^ gHangRecord.resetCount;
+  h = (h * 31) ^ (gHangRecord.reportPending ? 1u : 0u);
+  return h;
+}
+
+// Timer ISR: feed the watchdog only while the current site is in budget
+static void supervisorTick(timer_callback_args_t *args) {
+  (void)args;
+  uint32_t now  = millis();
+  uint8_t  site = gHangRecord.site;
+  uint32_t budget = SITE_BUDGET_MS[site < HANG_SITE_COUNT ? site : HANG_SITE_NONE];
+
+  if (now - gHangRecord.enteredAt <= budget) {
+    WDT.refresh();
+    gHangRecord.lastRefreshAt = now;
+  }
+}
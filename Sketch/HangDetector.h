@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Call sites we can attribute a hang to. Keep in sync with the name and
+// budget tables in HangDetector.cpp.
+enum HangSite : uint8_t {
+  HANG_SITE_NONE = 0,
+  HANG_SITE_LOOP,            // loop() body outside any other site
+  HANG_SITE_WIFI_CONNECT,    // connectWithStoredCredentials()
+  HANG_SITE_MQTT_CONNECT,    // connectToMqttBroker()
+  HANG_SITE_MQTT_POLL,       // gMqttClient.poll()
+  HANG_SITE_MQTT_PUBLISH,    // mqttPublishTelemetry()
+  HANG_SITE_DHT_READ,        // dht.readHumidity() / dht.readTemperature()
+  HANG_SITE_CONFIG_PORTAL,   // runProvisioningPortal() accept loop
+  HANG_SITE_CONFIG_CLIENT,   // handleConfigClient()
+  HANG_SITE_BATCH_UPLOAD,    // batchUploadLoop()
+  HANG_SITE_COUNT
+};
+
+// Breadcrumb + last hang report. Lives in .noinit RAM so it survives a
+// watchdog reset (but not a power cycle).
+struct HangRecord {
+  uint32_t magic;
+  // Live breadcrumb (written on every site entry)
+  volatile uint8_t  site;
+  volatile uint32_t enteredAt;      // millis() at site entry
+  volatile uint32_t lastRefreshAt;  // millis() of last watchdog refresh
+  // Report carried across the reset until it has been published
+  uint8_t  reportSite;
+  uint32_t reportStalledMs;
+  uint16_t resetCount;
+  bool     reportPending;
+  uint32_t reportCheck;
+};
+
+extern HangRecord gHangRecord;
+
+// Check the reset cause, capture a hang report if the last reset was a
+// watchdog reset, then start the watchdog. Call early in setup().
+void hangDetectorBegin();
+
+// If a hang report is pending, format it as JSON into out and return true.
+// Call hangDetectorReportSent() once it has been published.
+bool hangDetectorPendingReport(String &out);
+void hangDetectorReportSent();
+
+// Mark entry into a site: two stores and a millis() read.
+static inline void hangEnter(HangSite site) {
+  gHangRecord.enteredAt = millis();
+  gHangRecord.site = site;
+}
+
+// Scoped breadcrumb: enters a site and restores the enclosing one on exit.
+//   HangScope hang(HANG_SITE_DHT_READ);
+class HangScope {
+public:
+  explicit HangScope(HangSite site) : prevSite_(gHangRecord.site) {
+    hangEnter(site);
+  }
+  ~HangScope() {
+    // Back in the enclosing site, which just made progress: restart its clock
+    hangEnter((HangSite)prevSite_);
+  }
+private:
+  uint8_t prevSite_;
+};
@@ -0,0 +1,149 @@
+// MqttSnClient.cpp
+#include "MqttSnClient.h"
+
+// --- 1. PROTOCOL CONSTANTS (MQTT-SN v1.2) ---------------------------
+
+static const uint8_t MSG_CONNECT    = 0x04;
+static const uint8_t MSG_CONNACK    = 0x05;
+static const uint8_t MSG_PUBLISH    = 0x0C;
+static const uint8_t MSG_PUBACK     = 0x0D;
+static const uint8_t MSG_DISCONNECT = 0x18;
+
+static const uint8_t FLAG_DUP              = 0x80;
+static const uint8_t FLAG_CLEAN_SESSION    = 0x04;
+static const uint8_t FLAG_TOPIC_PREDEFINED = 0x01;
+static const uint8_t FLAG_QOS_0            = 0x00;
+static const uint8_t FLAG_QOS_1            = 0x20;
+static const uint8_t FLAG_QOS_M1           = 0x60;
+static const uint8_t PROTOCOL_ID           = 0x01;
+static const uint8_t RC_ACCEPTED           = 0x00;
+
+static const uint32_t RESPONSE_TIMEOUT_MS = 1000;  // a LAN gateway answers in a few ms
+static const uint8_t  RETRIES             = 3;
+
+// --- 2. PUBLIC API IMPLEMENTATIONS ----------------------------------
+
+void MqttSnClient::begin(const char *gatewayHost, uint16_t gatewayPort, const char *clientId, uint16_t localPort) {
+  host_     = gatewayHost;
+  port_     = gatewayPort;
+  clientId_ = clientId;
+  udp_.begin(localPort);
+}
+
+bool MqttSnClient::connect(uint16_t keepAliveS, bool cleanSession) {
+  size_t idLen = strlen(clientId_);
+  size_t len   = 6 + idLen;
+  if (len > sizeof(tx_)) return false;
+
+  tx_[0] = (uint8_t)len;
+  tx_[1] = MSG_CONNECT;
+  tx_[2] = cleanSession ? FLAG_CLEAN_SESSION : 0;
+  tx_[3] = PROTOCOL_ID;
+  tx_[4] = keepAliveS >> 8;
+  tx_[5] = keepAliveS & 0xFF;
+  memcpy(tx_ + 6, clientId_, idLen);
+
+  for (uint8_t attempt = 0; attempt < RETRIES; attempt++) {
+    if (!sendPacket(tx_, len)) continue;
+    if (awaitPacket(MSG_CONNACK, 0) >= 3) {
+      if (rx_[2] != RC_ACCEPTED) break;
+      state_ = STATE_ACTIVE;
+      return true;
+    }
+  }
+  state_ = STATE_DISCONNECTED;
+  return false;
+}
+
+bool MqttSnClient::publish(uint16_t topicId, const uint8_t *data, size_t len, int8_t qos) {
+  if (qos >= 0 && state_ != STATE_ACTIVE) return false;
+
+  // Length is one byte up to 255, else 0x01 followed by two bytes
+  size_t header = 7;
+  size_t total  = header + len;
+  if (total > 255) {
+    header += 2;
+    total  += 2;
+  }
+  if (total > sizeof(tx_)) return false;
+
+  uint16_t msgId = qos == 1 ? nextMsgId_++ : 0;
+  if (nextMsgId_ == 0) nextMsgId_ = 1;
+
+  size_t i = 0;
+  if (header == 9) {
+    tx_[i++] = 0x01;
+    tx_[i++] = total >> 8;
+    tx_[i++] = total & 0xFF;
+  } else {
+    tx_[i++] = (uint8_t)total;
+  }
+  tx_[i++] = MSG_PUBLISH;
+  size_t flagsAt = i;
+  tx_[i++] = (qos == 1 ? FLAG_QOS_1 : qos == 0 ? FLAG_QOS_0 : FLAG_QOS_M1) | FLAG_TOPIC_PREDEFINED;
+  tx_[i++] = topicId >> 8;
+  tx_[i++] = topicId & 0xFF;
+  tx_[i++] = msgId >> 8;
+  tx_[i++] = msgId & 0xFF;
+  memcpy(tx_ + i, data, len);
+
+  if (qos != 1) {
+    return sendPacket(tx_, total);
+  }
+
+  for (uint8_t attempt = 0; attempt < RETRIES; attempt++) {
+    if (attempt > 0) tx_[flagsAt] |= FLAG_DUP;  // retransmission
+    if (!sendPacket(tx_, total)) continue;
+    if (awaitPacket(MSG_PUBACK, msgId) >= 7) {
+      return rx_[6] == RC_ACCEPTED;
+    }
+  }
+  return false;
+}
+
+bool MqttSnClient::sleep(uint16_t durationS) {
+  uint8_t packet[4] = {4, MSG_DISCONNECT, (uint8_t)(durationS >> 8), (uint8_t)(durationS & 0xFF)};
+  for (uint8_t attempt = 0; attempt < RETRIES; attempt++) {
+    if (!sendPacket(packet, sizeof(packet))) continue;
+    if (awaitPacket(MSG_DISCONNECT, 0) >= 2) {
+      state_ = STATE_ASLEEP;
+      return true;
+    }
+  }
+  state_ = STATE_DISCONNECTED;
+  return false;
+}
+
+// --- 3. INTERNAL HELPERS --------------------------------------------
+
+bool MqttSnClient::sendPacket(const uint8_t *buf, size_t len) {
+  if (!udp_.beginPacket(host_, port_)) return false;
+  udp_.write(buf, len);
+  if (!udp_.endPacket()) return false;
+  stats_.packetsOut++;
+  stats_.bytesOut += len;
+  return true;
+}
+
+// Wait for a packet of the given type (and message ID, if non-zero) from
+// the gateway. Returns its length with the packet in rx_, or -1 on timeout.
+int MqttSnClient::awaitPacket(uint8_t type, uint16_t msgId) {
+  unsigned long startedAt = millis();
+  while (millis() - startedAt < RESPONSE_TIMEOUT_MS) {
+    int size = udp_.parsePacket();
+    if (size <= 0) {
+      delay(1);
+      continue;
+    }
+    int n = udp_.read(rx_, sizeof(rx_));
+    if (n < 2) continue;
+    stats_.packetsIn++;
+    stats_.bytesIn += n;
+
+    // Only the one-byte length form is used for gateway responses
+    if (rx_[1] != type) continue;
+    if (msgId != 0 && (n < 6 || (uint16_t)((rx_[4] << 8) | rx_[5]) != msgId)) continue;
+    return n;
+  }
+  return -1;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiS3.h>
+
+// Minimal MQTT-SN v1.2 client over UDP, enough for a publish-only sensor:
+// CONNECT, PUBLISH (QoS -1/0/1) to pre-defined topic IDs and the sleeping
+// client DISCONNECT. No REGISTER/SUBSCRIBE: topic IDs are agreed with the
+// gateway in advance (see local-env/mqttsn_gateway.py).
+class MqttSnClient {
+public:
+  // QoS -1: a single datagram, allowed while disconnected or asleep
+  static const int8_t QOS_FIRE_AND_FORGET = -1;
+
+  // Everything sent/received at the MQTT-SN layer (UDP payloads)
+  struct Stats {
+    uint32_t bytesOut;
+    uint32_t bytesIn;
+    uint32_t packetsOut;
+    uint32_t packetsIn;
+  };
+
+  explicit MqttSnClient(WiFiUDP &udp) : udp_(udp) {}
+
+  void begin(const char *gatewayHost, uint16_t gatewayPort, const char *clientId, uint16_t localPort);
+
+  // CONNECT and wait for CONNACK. cleanSession=false wakes a sleeping
+  // session instead of starting a new one.
+  bool connect(uint16_t keepAliveS, bool cleanSession);
+
+  // Publish to a pre-defined topic ID. QoS 1 waits for the PUBACK (and
+  // retries); QoS 0 needs an active connection; QoS -1 needs nothing.
+  bool publish(uint16_t topicId, const uint8_t *data, size_t len, int8_t qos);
+
+  // Sleeping client: DISCONNECT with a duration. The gateway keeps the
+  // session for durationS; connect(..., false) wakes it again.
+  bool sleep(uint16_t durationS);
+
+  bool connected() const { return state_ == STATE_ACTIVE; }
+  bool asleep() const { return state_ == STATE_ASLEEP; }
+  const Stats &stats() const { return stats_; }
+
+private:
+  enum State : uint8_t { STATE_DISCONNECTED, STATE_ACTIVE, STATE_ASLEEP };
+
+  static const size_t MAX_PACKET = 256;
+
+  bool sendPacket(const uint8_t *buf, size_t len);
+  int  awaitPacket(uint8_t type, uint16_t msgId);
+
+  WiFiUDP    &udp_;
+  const char *host_     = nullptr;
+  uint16_t    port_     = 0;
+  const char *clientId_ = "";
+  State       state_    = STATE_DISCONNECTED;
+  uint16_t    nextMsgId_ = 1;
+  Stats       stats_    = {0, 0, 0, 0};
+  uint8_t     tx_[MAX_PACKET];
+  uint8_t     rx_[MAX_PACKET];
+};
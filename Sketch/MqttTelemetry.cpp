@@ -3,19 +3,68 @@
 #include <WiFiS3.h>
 
 #include "MqttTelemetry.h"
+#include "MqttSnClient.h"
+#include "BatchUpload.h"
+#include "HangDetector.h"
 
 // --- 1. MQTT CONFIG FOR UNO R4 (DEVICE SIDE, TCP, NOT WEBSOCKETS) ---
 
+// Local stand-in environment (local-env/): uncomment and set to the LAN IP
+// of the machine running the local Mosquitto broker.
+// #define CIRCUIT5_LOCAL_BROKER "192.168.1.50"
+
 // Broker host and port (plain MQTT over TCP)
+#ifdef CIRCUIT5_LOCAL_BROKER
+static const char MQTT_BROKER[] = CIRCUIT5_LOCAL_BROKER;
+#else
 static const char MQTT_BROKER[] = "broker.hivemq.com";
+#endif
 static const int  MQTT_PORT     = 1883; // device uses normal MQTT, not WebSockets
 
-// Topic the UNO publishes to
+// Topic the UNO publishes to. Telemetry goes at QoS 1: brokers only queue
+// QoS 1 messages for the ingester's persistent session while it is offline
+// (Mosquitto's queue_qos0_messages is off by default).
 static const char MQTT_TOPIC[]  = "hope/iot/circuit5/living-room/uno-r4/telemetry";
+static const uint8_t MQTT_TELEMETRY_QOS = 1;
+
+// Priority alert lane (transitions + sensor faults, QoS 1)
+static const char MQTT_ALERT_TOPIC[] = "hope/iot/circuit5/living-room/uno-r4/alert";
+
+// Diagnostics (e.g. hang reports after a watchdog reset)
+static const char MQTT_DIAG_TOPIC[] = "hope/iot/circuit5/living-room/uno-r4/diagnostics";
 
 // Client ID for this device (any unique-ish string is fine)
 static const char MQTT_CLIENT_ID[] = "uno-r4-living-room";
 
+// Reported in telemetry so the fleet overview (/latest) shows what each board runs
+static const char FIRMWARE_VERSION[] = "1.4.0";
+
+// Device clock: epoch time from the Wi-Fi module (NTP), re-read this often.
+// Telemetry carries it as "ts" so a backlog replayed by the broker keeps the
+// times the readings were taken.
+static const uint32_t CLOCK_RESYNC_MS = 3600000UL;
+static const uint32_t CLOCK_RETRY_MS  = 60000UL;   // while the module has no time yet
+
+// Optional MQTT-SN transport: UDP to an MQTT-SN gateway (local stand-in:
+// local-env/mqttsn_gateway.py) instead of a TCP connection to the broker.
+// Uncomment and set to the gateway's LAN IP to use it.
+// #define CIRCUIT5_MQTTSN_GATEWAY "192.168.1.50"
+
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+static const uint16_t MQTTSN_GATEWAY_PORT = 10000;
+static const uint16_t MQTTSN_LOCAL_PORT   = 10001;
+
+// Topic IDs pre-defined on the gateway (same table as mqttsn_gateway.py),
+// so no topic names or REGISTER round trips go over the air
+static const uint16_t MQTTSN_TOPIC_TELEMETRY = 1;
+static const uint16_t MQTTSN_TOPIC_ALERT     = 2;
+static const uint16_t MQTTSN_TOPIC_DIAG      = 3;
+
+// Sleeping client: the gateway keeps the session this long between wakes
+static const uint16_t MQTTSN_SLEEP_S     = 3600;
+static const uint16_t MQTTSN_KEEPALIVE_S = 60;   // while awake
+#endif
+
 // --- 2. GLOBAL MQTT OBJECTS ---
 
 // WiFi client used by MQTT
@@ -24,12 +73,84 @@ static WiFiClient wifiClient;
 // ArduinoMqttClient instance
 static MqttClient gMqttClient(wifiClient);
 
-// Forward declaration of internal helper
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+static WiFiUDP      wifiUdp;
+static MqttSnClient gSnClient(wifiUdp);
+#endif
+
+// --- ALERT LANE STATE ---
+// Fixed slots, formatted into a reserved buffer at send time: no heap use
+// on the alert path.
+static const uint8_t ALERT_SLOTS       = 4;
+static const size_t  ALERT_PAYLOAD_MAX = 160;
+
+struct PendingAlert {
+  AlertKind     kind;
+  float         temperature;
+  float         humidity;
+  unsigned long detectedAt;  // millis() when the transition was detected
+  uint32_t      seq;
+};
+
+static PendingAlert gAlertQueue[ALERT_SLOTS];
+static uint8_t      gAlertHead    = 0;   // oldest pending alert
+static uint8_t      gAlertCount   = 0;
+static uint32_t     gAlertSeq     = 0;
+static uint32_t     gAlertDropped = 0;
+static char         gAlertPayload[ALERT_PAYLOAD_MAX];
+
+// Latency of each lane, measured separately (ms)
+struct LaneLatency {
+  uint32_t count;
+  uint32_t totalMs;
+  uint32_t maxMs;
+};
+static LaneLatency gAlertLatency     = {0, 0, 0};  // detected -> sent
+static LaneLatency gTelemetryLatency = {0, 0, 0};  // publish call -> sent
+
+// Transport cost per telemetry reading at the MQTT / MQTT-SN layer (TCP,
+// UDP and IP headers not included), to compare the two transports
+struct TransportCost {
+  uint32_t readings;
+  uint32_t bytesOut;
+  uint32_t bytesIn;
+  uint32_t packets;
+};
+static TransportCost gTelemetryCost = {0, 0, 0, 0};
+
+// Epoch seconds at millis() == gMillisAtSync (0 = no time yet)
+static uint32_t gEpochAtSync    = 0;
+static uint32_t gMillisAtSync   = 0;
+static uint32_t gClockCheckedAt = 0;
+static bool     gClockChecked   = false;
+
+// Forward declaration of internal helpers
 static void connectToMqttBroker();
+static void flushPendingAlerts();
+static bool sendAlert(const PendingAlert &alert);
+static void recordLatency(LaneLatency &lane, uint32_t ms, const char *name);
+static void recordTransportCost(uint32_t bytesOut, uint32_t bytesIn, uint32_t packets);
+static bool transportConnected();
+static void syncDeviceClock();
+static bool formatDeviceTime(char *out, size_t size);
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+static bool wakeSnSession();
+#endif
 
 // --- 3. PUBLIC API IMPLEMENTATIONS ----------------------------------
 
 void mqttSetup() {
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+  Serial.println("MQTT-SN: Initialising client...");
+  gSnClient.begin(CIRCUIT5_MQTTSN_GATEWAY, MQTTSN_GATEWAY_PORT, MQTT_CLIENT_ID, MQTTSN_LOCAL_PORT);
+
+  // Create the session once, then let it sleep until there is QoS 1 traffic
+  if (wakeSnSession()) {
+    gSnClient.sleep(MQTTSN_SLEEP_S);
+  }
+  return;
+#endif
+
   Serial.println("MQTT: Initialising client...");
 
   // Set client ID and keepalive
@@ -46,22 +167,41 @@ void mqttSetup() {
 
 
 void mqttLoop() {
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+  // No connection to keep alive: the session sleeps on the gateway
+  flushPendingAlerts();
+  return;
+#endif
+
   // Keep MQTT connection alive
   if (!gMqttClient.connected()) {
     connectToMqttBroker();
   }
 
+  // Anything held in the alert lane goes out before other traffic
+  flushPendingAlerts();
+
+  HangScope hang(HANG_SITE_MQTT_POLL);
   gMqttClient.poll();
 }
 
 void mqttPublishTelemetry(float temperature, float humidity, const String &status) {
+  HangScope hang(HANG_SITE_MQTT_PUBLISH);
+  unsigned long startedAt = millis();
+
+#ifndef CIRCUIT5_MQTTSN_GATEWAY
   if (!gMqttClient.connected()) {
     connectToMqttBroker();
     if (!gMqttClient.connected()) {
       Serial.println("MQTT: still not connected, skipping telemetry publish.");
+      batchUploadBuffer(temperature, humidity, status);  // HTTP fallback, if enabled
       return;
     }
   }
+#endif
+
+  // Alerts are never queued behind routine telemetry
+  flushPendingAlerts();
 
   // Build JSON payload
   String payload = "{";
@@ -74,21 +214,265 @@ void mqttPublishTelemetry(float temperature, float humidity, const String &statu
   payload += ",";
   payload += "\"status\":\"";
   payload += status;
-  payload += "\"}";
+  payload += "\",\"fw\":\"";
+  payload += FIRMWARE_VERSION;
+  payload += "\"";
+  syncDeviceClock();
+  char ts[16];
+  if (formatDeviceTime(ts, sizeof(ts))) {
+    payload += ",\"ts\":";
+    payload += ts;
+  }
+  payload += "}";
 
   Serial.print("MQTT: Publishing to ");
   Serial.print(MQTT_TOPIC);
   Serial.print(" => ");
   Serial.println(payload);
 
-  gMqttClient.beginMessage(MQTT_TOPIC);
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+  // One datagram: QoS -1 needs no connection, so the session stays asleep
+  MqttSnClient::Stats before = gSnClient.stats();
+  gSnClient.publish(MQTTSN_TOPIC_TELEMETRY, (const uint8_t *)payload.c_str(), payload.length(),
+                    MqttSnClient::QOS_FIRE_AND_FORGET);
+  const MqttSnClient::Stats &after = gSnClient.stats();
+  recordTransportCost(after.bytesOut - before.bytesOut, after.bytesIn - before.bytesIn,
+                      (after.packetsOut - before.packetsOut) + (after.packetsIn - before.packetsIn));
+#else
+  gMqttClient.beginMessage(MQTT_TOPIC, false, MQTT_TELEMETRY_QOS);
   gMqttClient.print(payload);
   gMqttClient.endMessage();
+
+  // PUBLISH (QoS 1): fixed header + topic name + packet ID + payload; the
+  // broker's PUBACK (4 bytes) is read by poll()
+  uint32_t remaining = 2 + strlen(MQTT_TOPIC) + 2 + payload.length();
+  recordTransportCost(1 + (remaining < 128 ? 1 : 2) + remaining, 4, 2);
+#endif
+
+  recordLatency(gTelemetryLatency, millis() - startedAt, "telemetry");
+}
+
+void mqttPublishAlert(AlertKind kind, float temperature, float humidity) {
+  if (gAlertCount == ALERT_SLOTS) {
+    // Lane full (long outage): drop the oldest, the newest state matters most
+    gAlertHead = (gAlertHead + 1) % ALERT_SLOTS;
+    gAlertCount--;
+    gAlertDropped++;
+  }
+
+  PendingAlert &slot = gAlertQueue[(gAlertHead + gAlertCount) % ALERT_SLOTS];
+  slot.kind        = kind;
+  slot.temperature = temperature;
+  slot.humidity    = humidity;
+  slot.detectedAt  = millis();
+  slot.seq         = ++gAlertSeq;
+  gAlertCount++;
+
+#ifndef CIRCUIT5_MQTTSN_GATEWAY
+  if (!gMqttClient.connected()) {
+    connectToMqttBroker();
+  }
+#endif
+  flushPendingAlerts();
+}
+
+bool mqttPublishDiagnostic(const String &json) {
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+  if (!wakeSnSession()) {
+    return false;
+  }
+#else
+  if (!gMqttClient.connected()) {
+    return false;
+  }
+#endif
+
+  // {"deviceId":"...", <fields of json>}
+  String payload = "{\"deviceId\":\"uno-r4-living-room\",";
+  payload += json.substring(1);
+
+  Serial.print("MQTT: Publishing diagnostic => ");
+  Serial.println(payload);
+
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+  bool sent = gSnClient.publish(MQTTSN_TOPIC_DIAG, (const uint8_t *)payload.c_str(), payload.length(), 1);
+  gSnClient.sleep(MQTTSN_SLEEP_S);
+  return sent;
+#endif
+
+  gMqttClient.beginMessage(MQTT_DIAG_TOPIC, false, 1);
+  gMqttClient.print(payload);
+  return gMqttClient.endMessage() == 1;
+}
+
+// --- 4. INTERNAL HELPERS --------------------------------------------
+
+static const char *alertKindName(AlertKind kind) {
+  switch (kind) {
+    case ALERT_RAISED:       return "raised";
+    case ALERT_CLEARED:      return "cleared";
+    case ALERT_SENSOR_FAULT: return "sensorFault";
+    case ALERT_SENSOR_OK:    return "sensorOk";
+  }
+  return "unknown";
+}
+
+// Format a reading with 2 decimals (or null for NaN) without printf floats
+static int formatReading(char *out, size_t size, float value) {
+  if (isnan(value)) {
+    return snprintf(out, size, "null");
+  }
+  long scaled = lroundf(value * 100.0f);
+  const char *sign = scaled < 0 ? "-" : "";
+  if (scaled < 0) scaled = -scaled;
+  return snprintf(out, size, "%s%ld.%02ld", sign, scaled / 100, scaled % 100);
+}
+
+static bool sendAlert(const PendingAlert &alert) {
+  char temperature[12];
+  char humidity[12];
+  formatReading(temperature, sizeof(temperature), alert.temperature);
+  formatReading(humidity, sizeof(humidity), alert.humidity);
+
+  unsigned long queuedMs = millis() - alert.detectedAt;
+  int len = snprintf(gAlertPayload, sizeof(gAlertPayload),
+                     "{\"deviceId\":\"%s\",\"event\":\"%s\",\"temperature\":%s,"
+                     "\"humidity\":%s,\"seq\":%lu,\"queuedMs\":%lu,\"dropped\":%lu}",
+                     MQTT_CLIENT_ID, alertKindName(alert.kind), temperature, humidity,
+                     (unsigned long)alert.seq, queuedMs, (unsigned long)gAlertDropped);
+  if (len < 0 || (size_t)len >= sizeof(gAlertPayload)) {
+    return true;  // cannot happen with the fixed fields above; don't wedge the lane
+  }
+
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+  if (!gSnClient.publish(MQTTSN_TOPIC_ALERT, (const uint8_t *)gAlertPayload, (size_t)len, 1)) {
+    return false;
+  }
+#else
+  gMqttClient.beginMessage(MQTT_ALERT_TOPIC, (unsigned long)len, false, 1);
+  gMqttClient.write((const uint8_t *)gAlertPayload, (size_t)len);
+  if (gMqttClient.endMessage() != 1) {
+    return false;
+  }
+#endif
+
+  Serial.print("MQTT: Alert sent => ");
+  Serial.println(gAlertPayload);
+  recordLatency(gAlertLatency, millis() - alert.detectedAt, "alert");
+  return true;
+}
+
+// Send pending alerts oldest-first; stop at the first failure and keep the rest
+static void flushPendingAlerts() {
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+  // QoS 1 needs an active session: wake it only when there is something to send
+  if (gAlertCount == 0 || !wakeSnSession()) {
+    return;
+  }
+#endif
+
+  while (gAlertCount > 0 && transportConnected()) {
+    if (!sendAlert(gAlertQueue[gAlertHead])) {
+      Serial.println("MQTT: alert publish failed, will retry.");
+      break;
+    }
+    gAlertHead = (gAlertHead + 1) % ALERT_SLOTS;
+    gAlertCount--;
+  }
+
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+  gSnClient.sleep(MQTTSN_SLEEP_S);
+#endif
+}
+
+static bool transportConnected() {
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+  return gSnClient.connected();
+#else
+  return gMqttClient.connected();
+#endif
+}
+
+#ifdef CIRCUIT5_MQTTSN_GATEWAY
+// CONNECT without clean session: resumes the sleeping session (or creates it)
+static bool wakeSnSession() {
+  if (gSnClient.connected()) return true;
+  HangScope hang(HANG_SITE_MQTT_CONNECT);
+  if (!gSnClient.connect(MQTTSN_KEEPALIVE_S, false)) {
+    Serial.println("MQTT-SN: gateway not answering, will retry.");
+    return false;
+  }
+  return true;
+}
+#endif
+
+// Read the module's clock once an hour (every minute until it has one)
+static void syncDeviceClock() {
+  uint32_t now = millis();
+  uint32_t interval = gEpochAtSync ? CLOCK_RESYNC_MS : CLOCK_RETRY_MS;
+  if (gClockChecked && now - gClockCheckedAt < interval) {
+    return;
+  }
+  gClockChecked   = true;
+  gClockCheckedAt = now;
+
+  unsigned long epoch = WiFi.getTime();   // 0 until the module has synced over NTP
+  if (epoch > 1600000000UL) {
+    gEpochAtSync  = epoch;
+    gMillisAtSync = now;
+  }
 }
 
-// --- 4. INTERNAL HELPER ---------------------------------------------
+// Current time as epoch milliseconds; false while there is no clock yet
+static bool formatDeviceTime(char *out, size_t size) {
+  if (gEpochAtSync == 0) {
+    return false;
+  }
+  uint32_t elapsed = millis() - gMillisAtSync;
+  snprintf(out, size, "%lu%03lu", (unsigned long)(gEpochAtSync + elapsed / 1000),
+           (unsigned long)(elapsed % 1000));
+  return true;
+}
+
+static void recordTransportCost(uint32_t bytesOut, uint32_t bytesIn, uint32_t packets) {
+  gTelemetryCost.readings++;
+  gTelemetryCost.bytesOut += bytesOut;
+  gTelemetryCost.bytesIn  += bytesIn;
+  gTelemetryCost.packets  += packets;
+
+  if (gTelemetryCost.readings % 20 == 1) {
+    Serial.print("MQTT: per reading ");
+    Serial.print(gTelemetryCost.bytesOut / gTelemetryCost.readings);
+    Serial.print(" B out, ");
+    Serial.print(gTelemetryCost.bytesIn / gTelemetryCost.readings);
+    Serial.print(" B in, ");
+    Serial.print((float)gTelemetryCost.packets / gTelemetryCost.readings);
+    Serial.println(" packets (protocol layer, excl. TCP/UDP/IP)");
+  }
+}
+
+static void recordLatency(LaneLatency &lane, uint32_t ms, const char *name) {
+  lane.count++;
+  lane.totalMs += ms;
+  if (ms > lane.maxMs) lane.maxMs = ms;
+
+  // Occasional summary so the two lanes can be compared on the serial log
+  if (lane.count % 20 == 1) {
+    Serial.print("MQTT: ");
+    Serial.print(name);
+    Serial.print(" latency avg ");
+    Serial.print(lane.totalMs / lane.count);
+    Serial.print(" ms, max ");
+    Serial.print(lane.maxMs);
+    Serial.print(" ms over ");
+    Serial.print(lane.count);
+    Serial.println(" sends");
+  }
+}
 
 static void connectToMqttBroker() {
+  HangScope hang(HANG_SITE_MQTT_CONNECT);
+
   Serial.print("MQTT: Connecting to broker ");
   Serial.print(MQTT_BROKER);
   Serial.print(":");
@@ -108,5 +492,5 @@ static void connectToMqttBroker() {
     delay(2000);
   }
 
-  Serial.println("MQTT: Connected to HiveMQ broker.");
+  Serial.println("MQTT: Connected to broker.");
 }
@@ -13,3 +13,19 @@ void mqttLoop();
 // Publish the temperature/humidity/status telemetry JSON
 // to the configured MQTT topic.
 void mqttPublishTelemetry(float temperature, float humidity, const String &status);
+
+// Priority alert lane: alert-state transitions and sensor faults.
+// Sent on the device's alert topic at QoS 1 from a pre-reserved buffer,
+// always ahead of routine telemetry. If the broker is unreachable the alert
+// is held (oldest dropped if the lane overflows) and sent first on reconnect.
+enum AlertKind : uint8_t {
+  ALERT_RAISED,        // reading crossed a threshold
+  ALERT_CLEARED,       // back within thresholds
+  ALERT_SENSOR_FAULT,  // DHT read failed (NaN)
+  ALERT_SENSOR_OK      // DHT reads recovered
+};
+void mqttPublishAlert(AlertKind kind, float temperature, float humidity);
+
+// Publish a diagnostic event (JSON object, deviceId is added) to the
+// device's diagnostics topic at QoS 1. Returns true if it was sent.
+bool mqttPublishDiagnostic(const String &json);
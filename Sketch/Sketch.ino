@@ -22,6 +22,8 @@
 
 #include "WiFiProvisioning.h"
 #include "MqttTelemetry.h"
+#include "HangDetector.h"
+#include "BatchUpload.h"
 
 // ---------- 2. HARDWARE PINS & OBJECTS ----------
 
@@ -47,10 +49,20 @@ unsigned long lastSensorReadMillis = 0;
 unsigned long lastBlinkMillis      = 0;
 bool          redLedState          = LOW;
 String        alertStatus          = "normal";
+bool          thresholdAlert       = false;  // last threshold state sent on the alert lane
+bool          sensorFault          = false;  // DHT currently failing
 
 // Wi-Fi credentials (managed by WiFiProvisioning module)
 WifiCredentials gWifiCreds;
 
+// Publish a hang report left by a watchdog reset (retried until sent)
+void publishPendingHangReport() {
+  String report;
+  if (hangDetectorPendingReport(report) && mqttPublishDiagnostic(report)) {
+    hangDetectorReportSent();
+  }
+}
+
 // =====================================================================
 //                        5. SETUP & LOOP
 // =====================================================================
@@ -58,6 +70,9 @@ WifiCredentials gWifiCreds;
 void setup() {
   Serial.begin(9600);
 
+  // Watchdog-backed hang detector (reports the stalled call after a reset)
+  hangDetectorBegin();
+
   pinMode(GREEN_LED_PIN, OUTPUT);
   pinMode(RED_LED_PIN,   OUTPUT);
 
@@ -102,6 +117,7 @@ void setup() {
 
   // --- MQTT setup (now handled by module) ---
   mqttSetup();
+  publishPendingHangReport();
 
   lcd.clear();
   lcd.print("System Ready");
@@ -110,6 +126,8 @@ void setup() {
 }
 
 void loop() {
+  hangEnter(HANG_SITE_LOOP);
+
   // --- Keep Wi-Fi & MQTT alive ---
 
   // If Wi-Fi drops, try reconnecting using stored credentials
@@ -121,25 +139,46 @@ void loop() {
   // Let MQTT module handle its own connection/polling logic
   mqttLoop();
 
+  // Upload readings buffered while the broker was unreachable (HTTP fallback)
+  batchUploadLoop();
+
   // --- Sensor logic every 10 seconds ---
 
   if (millis() - lastSensorReadMillis >= 3000) {
     lastSensorReadMillis = millis();
 
-    float humidity    = dht.readHumidity();
-    float temperature = dht.readTemperature();
+    float humidity, temperature;
+    {
+      HangScope hang(HANG_SITE_DHT_READ);
+      humidity    = dht.readHumidity();
+      temperature = dht.readTemperature();
+    }
 
     if (isnan(humidity) || isnan(temperature)) {
       Serial.println(F("Failed to read from DHT sensor!"));
       lcd.clear();
       lcd.print("Sensor Error!");
       alertStatus = "alert";
+
+      // Priority lane: report the fault once per episode
+      if (!sensorFault) {
+        sensorFault = true;
+        mqttPublishAlert(ALERT_SENSOR_FAULT, temperature, humidity);
+      }
     } else {
+      if (sensorFault) {
+        sensorFault = false;
+        mqttPublishAlert(ALERT_SENSOR_OK, temperature, humidity);
+      }
+
       // Determine alert status
-      if (temperature < MIN_TEMP || temperature > MAX_TEMP || humidity > MAX_HUMIDITY) {
-        alertStatus = "alert";
-      } else {
-        alertStatus = "normal";
+      bool outOfRange = temperature < MIN_TEMP || temperature > MAX_TEMP || humidity > MAX_HUMIDITY;
+      alertStatus = outOfRange ? "alert" : "normal";
+
+      // Priority lane: send threshold transitions before the routine sample
+      if (outOfRange != thresholdAlert) {
+        thresholdAlert = outOfRange;
+        mqttPublishAlert(outOfRange ? ALERT_RAISED : ALERT_CLEARED, temperature, humidity);
       }
 
       // Update LCD
@@ -164,6 +203,8 @@ void loop() {
       // Publish telemetry via MQTT module
       mqttPublishTelemetry(temperature, humidity, alertStatus);
     }
+
+    publishPendingHangReport();
   }
 
   // --- LED alert behaviour ---
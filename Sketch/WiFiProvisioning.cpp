@@ -1,4 +1,5 @@
 #include "WiFiProvisioning.h"
+#include "HangDetector.h"
 
 #include <WiFiS3.h>
 #include <EEPROM.h>
@@ -47,6 +48,8 @@ void clearWifiCredentials() {
 
 // Try to connect to Wi-Fi using stored credentials
 bool connectWithStoredCredentials(WifiCredentials &creds, uint32_t timeoutMs) {
+  HangScope hang(HANG_SITE_WIFI_CONNECT);
+
   if (WiFi.status() == WL_NO_MODULE) {
     Serial.println("ERROR: WiFi module not found.");
     return false;
@@ -93,6 +96,7 @@ void runProvisioningPortal(WifiCredentials &creds) {
   configServer.begin();
 
   while (true) {
+    hangEnter(HANG_SITE_CONFIG_PORTAL);  // each accept iteration counts as progress
     WiFiClient client = configServer.available();
     if (client) {
       handleConfigClient(client, creds);
@@ -105,6 +109,8 @@ void runProvisioningPortal(WifiCredentials &creds) {
 // ===================== INTERNAL HELPERS =====================
 
 static void handleConfigClient(WiFiClient &client, WifiCredentials &creds) {
+  HangScope hang(HANG_SITE_CONFIG_CLIENT);
+
   String requestLine = "";
   String headers     = "";
   String body        = "";
@@ -1,15 +1,56 @@
+import collections
+import gzip
+import hashlib
+import hmac
 import json
+import os
+import queue
+import random
+import re
+import signal
+import threading
 import time
-from datetime import datetime, timezone
+import zlib
+from datetime import datetime, timedelta, timezone
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
 
 import paho.mqtt.client as mqtt  # pip install paho-mqtt
 import ssl # for TLS if needed
 
+# Set CIRCUIT5_ENV=local to run against the local stand-in environment
+# (Mosquitto + Firebase RTDB emulator, see local-env/README.txt) instead of
+# the public broker and the production database.
+LOCAL_ENV = os.environ.get("CIRCUIT5_ENV") == "local"
+
 # --- 1. MQTT CONFIG (MATCH UNO + DASHBOARD) ---
-BROKER = "broker.hivemq.com"
-PORT = 1883                     # public, non-TLS MQTT port
+BROKER = os.environ.get("CIRCUIT5_MQTT_HOST", "localhost" if LOCAL_ENV else "broker.hivemq.com")
+PORT = int(os.environ.get("CIRCUIT5_MQTT_PORT", "1883"))  # plain MQTT (public broker is non-TLS)
 TOPIC = "hope/iot/circuit5/living-room/uno-r4/telemetry"
 
+# Priority alert lane (alert transitions + sensor faults, QoS 1 from the device)
+ALERT_TOPIC = "hope/iot/circuit5/living-room/uno-r4/alert"
+
+# What we subscribe to: every room and device of our own sites, so the
+# aggregation stage sees the hierarchy below them
+# (hope/iot/<site>/<room>/<device>/...). The broker is public, so the site
+# level stays fixed: anyone can publish under hope/iot/. Comma-separated
+# list in CIRCUIT5_SITES.
+SITES = tuple(site.strip() for site in
+              os.environ.get("CIRCUIT5_SITES", "circuit5").split(",") if site.strip())
+TELEMETRY_FILTERS = [f"hope/iot/{site}/+/+/telemetry" for site in SITES]
+ALERT_FILTERS = [f"hope/iot/{site}/+/+/alert" for site in SITES]
+
+# Filters an earlier version left in the persistent session; removed on
+# connect so the broker stops routing every site to us
+STALE_FILTERS = ["hope/iot/+/+/+/telemetry", "hope/iot/+/+/+/alert"]
+
+# Persistent session: the broker keeps our subscription and queues QoS 1
+# messages while the ingester is down (restart/deploy), then replays them on
+# reconnect. The client ID must stay fixed for the broker to find the session.
+INGESTER_CLIENT_ID = "circuit5-firebase-ingester"
+SUBSCRIBE_QOS = 1
+SUBSCRIPTIONS = [(f, SUBSCRIBE_QOS) for f in TELEMETRY_FILTERS + ALERT_FILTERS]
+
 
 # --- 2. FIREBASE CONFIG (REALTIME DATABASE) ---
 #  a) In Firebase console, create a project.
@@ -20,10 +61,15 @@ TOPIC = "hope/iot/circuit5/living-room/uno-r4/telemetry"
 
 import firebase_admin           # pip install firebase-admin
 from firebase_admin import credentials, db
+from firebase_admin import exceptions as firebase_exceptions
 
 SERVICE_ACCOUNT_PATH = r"c:/Users/Alex/OneDrive/Desktop/Year 3/1 - Internet of Things/serviceAccountKey.json"
 DATABASE_URL = "https://iotsystem-circuit5-default-rtdb.europe-west1.firebasedatabase.app"
 
+# Local RTDB emulator (no service account needed; namespace = project ID)
+EMULATOR_HOST = os.environ.get("FIREBASE_DATABASE_EMULATOR_HOST", "localhost:9000")
+LOCAL_DATABASE_URL = f"http://{EMULATOR_HOST}?ns=iotsystem-circuit5"
+
 
 def init_firebase():
     """
@@ -31,15 +77,52 @@ def init_firebase():
     This script is a backend/ingester, so using Admin SDK is appropriate.
     """
     if not firebase_admin._apps:
-        cred = credentials.Certificate(SERVICE_ACCOUNT_PATH)
-        firebase_admin.initialize_app(cred, {
-            "databaseURL": DATABASE_URL
-        })
-    print("[Firebase] Initialised connection to Realtime Database.")
+        if LOCAL_ENV:
+            # The Admin SDK talks to the emulator when this variable is set
+            # and uses its own emulator credentials.
+            os.environ["FIREBASE_DATABASE_EMULATOR_HOST"] = EMULATOR_HOST
+            firebase_admin.initialize_app(options={
+                "databaseURL": LOCAL_DATABASE_URL
+            })
+        else:
+            cred = credentials.Certificate(SERVICE_ACCOUNT_PATH)
+            firebase_admin.initialize_app(cred, {
+                "databaseURL": DATABASE_URL
+            })
+    target = f"emulator at {EMULATOR_HOST}" if LOCAL_ENV else "Realtime Database"
+    print(f"[Firebase] Initialised connection to {target}.")
 
 
 # --- 3. TELEMETRY VALIDATION (similar to your JS) ---
 
+# Device IDs (and topic levels) become database path segments, so they must
+# be plain names: no '/', '.', '#', '$', '[' or ']'
+_SEGMENT = re.compile(r"^[A-Za-z0-9_-]{1,64}$")
+
+# Device timestamps ("ts", epoch ms) outside this range are ignored and the
+# reading is stamped on arrival instead
+SAMPLE_TS_MAX_AGE_S = 7 * 86400   # a broker backlog older than this is not trusted
+SAMPLE_TS_MAX_SKEW_S = 60         # device clock ahead of ours
+
+
+def valid_topic(topic: str) -> bool:
+    """
+    hope/iot/<site>/<room>/<device>/<kind> with site, room and device usable
+    as database path segments (they key the aggregates).
+    """
+    parts = topic.split("/")
+    return len(parts) == 6 and all(_SEGMENT.match(p) for p in parts[2:5])
+
+
+def topic_in_sites(topic: str) -> bool:
+    """
+    True if the topic is under one of our SITES. Checked before anything
+    else, so other sites' traffic never reaches admission control.
+    """
+    parts = topic.split("/", 3)
+    return len(parts) == 4 and parts[2] in SITES
+
+
 def parse_and_validate_payload(payload: str):
     """
     Parse MQTT payload as JSON and validate basic structure and ranges.
@@ -55,8 +138,19 @@ def parse_and_validate_payload(payload: str):
         print("[WARN] Payload is not a JSON object, ignoring:", data)
         return None
 
+    return validate_reading(data)
+
+
+def validate_reading(data: dict):
+    """
+    Range and type checks shared by MQTT telemetry and uploaded batches
+    (section 8). Returns the normalised reading or None.
+    """
     # Device ID is optional but recommended
     device_id = data.get("deviceId", "unknown-device")
+    if not isinstance(device_id, str) or not _SEGMENT.match(device_id):
+        print("[WARN] Invalid deviceId, ignoring:", device_id)
+        return None
 
     temp_raw = data.get("temperature")
     hum_raw = data.get("humidity")
@@ -81,30 +175,403 @@ def parse_and_validate_payload(payload: str):
     if status not in ("normal", "alert", "error", "unknown"):
         status = "unknown"
 
+    # Firmware version is optional (older boards don't send it)
+    firmware = data.get("fw")
+    firmware = firmware[:32] if isinstance(firmware, str) else None
+
+    # When the reading was taken, by the device's clock (optional): keeps a
+    # backlog the broker replays after an outage at its real times
+    sampled_at = None
+    ts = data.get("ts")
+    if isinstance(ts, (int, float)) and not isinstance(ts, bool):
+        now_s = time.time()
+        if now_s - SAMPLE_TS_MAX_AGE_S <= ts / 1000 <= now_s + SAMPLE_TS_MAX_SKEW_S:
+            sampled_at = datetime.fromtimestamp(ts / 1000, timezone.utc)
+
     return {
         "deviceId": device_id,
         "temperature": temperature,
         "humidity": humidity,
         "status": status,
+        "firmware": firmware,
+        "sampledAt": sampled_at,
+    }
+
+
+ALERT_EVENTS = ("raised", "cleared", "sensorFault", "sensorOk")
+
+
+def parse_alert_payload(payload: str):
+    """
+    Parse an alert-lane message from the device.
+    Returns {deviceId, event, temperature, humidity, seq, queuedMs} or None.
+    temperature/humidity are None for sensor faults.
+    """
+    try:
+        data = json.loads(payload)
+    except json.JSONDecodeError:
+        print("[WARN] Invalid alert JSON, ignoring:", payload)
+        return None
+
+    if not isinstance(data, dict) or data.get("event") not in ALERT_EVENTS:
+        print("[WARN] Unknown alert payload, ignoring:", data)
+        return None
+
+    device_id = data.get("deviceId", "unknown-device")
+    if not isinstance(device_id, str) or not _SEGMENT.match(device_id):
+        print("[WARN] Invalid deviceId in alert, ignoring:", device_id)
+        return None
+
+    def optional_float(value):
+        try:
+            return None if value is None else float(value)
+        except (TypeError, ValueError):
+            return None
+
+    def non_negative_int(value):
+        try:
+            return max(int(value), 0)
+        except (TypeError, ValueError):
+            return 0
+
+    return {
+        "deviceId": device_id,
+        "event": data["event"],
+        "temperature": optional_float(data.get("temperature")),
+        "humidity": optional_float(data.get("humidity")),
+        "seq": non_negative_int(data.get("seq")),
+        "queuedMs": non_negative_int(data.get("queuedMs")),
     }
 
 
-# --- 4. FIREBASE WRITE HELPER ---
+# --- 4. ADMISSION CONTROL (PER-DEVICE RATE LIMITING) ---
+# Runs before any decoding/validation so a board stuck in a tight publish loop
+# (or a spoofed client on the public topic) costs us a dict lookup, not a JSON
+# parse and a Firebase write. Only the topic and payload length are inspected.
+
+# Limits per device class. The class is taken from the device segment of the
+# topic (hope/iot/<site>/<room>/<device>/telemetry) and matched by prefix.
+#   rate        = sustained messages per second
+#   burst       = bucket size (messages allowed back-to-back)
+#   max_payload = largest accepted payload in bytes
+DEVICE_CLASS_LIMITS = {
+    "uno-r4":  {"rate": 1.0, "burst": 5, "max_payload": 256},  # publishes every 3 s
+    "default": {"rate": 0.2, "burst": 3, "max_payload": 256},
+}
+
+MAX_TRACKED_SOURCES = 1024      # cap on buckets kept in memory
+SOURCE_IDLE_EVICT_S = 300       # buckets idle this long can be evicted
+ADMISSION_REPORT_INTERVAL_S = 60
+
+# After a reconnect the broker replays the session backlog as fast as it can.
+# That burst is legitimate, so each source seen before the outage is credited
+# with the tokens it would have earned while we were away (capped at this
+# outage length). Credit the replay has not used by the deadline lapses.
+CATCHUP_MAX_OUTAGE_S = 3600
+CATCHUP_CREDIT_S = 60
+
+
+class TokenBucket:
+    __slots__ = ("rate", "capacity", "tokens", "last", "dropped", "credit_until")
+
+    def __init__(self, rate: float, capacity: float, now: float):
+        self.rate = rate
+        self.capacity = capacity
+        self.tokens = capacity
+        self.last = now
+        self.dropped = 0
+        self.credit_until = 0.0
+
+    def credit(self, seconds: float, now: float):
+        """
+        Add the tokens for seconds of traffic above the bucket size, usable
+        until CATCHUP_CREDIT_S from now.
+        """
+        self.tokens = max(self.tokens, self.capacity) + self.rate * seconds
+        self.credit_until = now + CATCHUP_CREDIT_S
+
+    def try_consume(self, now: float) -> bool:
+        # Refill up to capacity; a catch-up credit is only clamped down once
+        # its deadline has passed
+        if self.tokens > self.capacity and now > self.credit_until:
+            self.tokens = self.capacity
+        if self.tokens < self.capacity:
+            self.tokens = min(self.capacity, self.tokens + (now - self.last) * self.rate)
+        self.last = now
+        if self.tokens >= 1.0:
+            self.tokens -= 1.0
+            return True
+        self.dropped += 1
+        return False
+
+
+_buckets = {}                   # topic -> TokenBucket
+_limits_by_topic = {}           # topic -> limits dict (cached class lookup)
+admission_stats = {"accepted": 0, "rate_limited": 0, "oversize": 0, "untracked": 0}
+_last_admission_report = time.monotonic()
+
+
+def limits_for_topic(topic: str) -> dict:
+    """
+    Resolve the device-class limits for a topic (cached per topic).
+    """
+    limits = _limits_by_topic.get(topic)
+    if limits is None:
+        parts = topic.split("/")
+        device = parts[4] if len(parts) > 4 else ""
+        limits = DEVICE_CLASS_LIMITS["default"]
+        for prefix, candidate in DEVICE_CLASS_LIMITS.items():
+            if prefix != "default" and device.startswith(prefix):
+                limits = candidate
+                break
+        if len(_limits_by_topic) < MAX_TRACKED_SOURCES:
+            _limits_by_topic[topic] = limits
+    return limits
+
+
+def _evict_idle_buckets(now: float):
+    idle = [t for t, b in _buckets.items() if now - b.last > SOURCE_IDLE_EVICT_S]
+    for topic in idle:
+        del _buckets[topic]
+
+
+def admit_message(topic: str, payload_len: int) -> bool:
+    """
+    Admission check for one MQTT message. Returns False if the message should
+    be dropped (oversize or over the source's rate). Drops are only counted;
+    they are reported in aggregate by report_admission_stats().
+    """
+    limits = limits_for_topic(topic)
+    if payload_len > limits["max_payload"]:
+        admission_stats["oversize"] += 1
+        return False
+
+    now = time.monotonic()
+    bucket = _buckets.get(topic)
+    if bucket is None:
+        if len(_buckets) >= MAX_TRACKED_SOURCES:
+            _evict_idle_buckets(now)
+            if len(_buckets) >= MAX_TRACKED_SOURCES:
+                admission_stats["untracked"] += 1
+                return False
+        bucket = _buckets[topic] = TokenBucket(limits["rate"], limits["burst"], now)
+
+    if not bucket.try_consume(now):
+        admission_stats["rate_limited"] += 1
+        return False
+
+    admission_stats["accepted"] += 1
+    return True
+
+
+def credit_outage(outage_s: float):
+    """
+    Grant every source we already track the tokens for an outage of outage_s
+    seconds so the broker's session replay is not mistaken for flooding.
+    Sources first seen after the outage get no credit.
+    """
+    outage_s = min(max(outage_s, 0.0), CATCHUP_MAX_OUTAGE_S)
+    now = time.monotonic()
+    for bucket in _buckets.values():
+        bucket.credit(outage_s, now)
+
+
+def seed_known_sources(latest: dict):
+    """
+    After a process restart no source is tracked yet, so the devices in
+    /latest are: each is credited for the time since its last stored reading
+    (capped like credit_outage()).
+    """
+    now, wall_ms = time.monotonic(), time.time() * 1000
+    for snapshot in latest.values():
+        if not isinstance(snapshot, dict) or len(_buckets) >= MAX_TRACKED_SOURCES:
+            continue
+        topic, last_seen_ms = snapshot.get("topic"), snapshot.get("lastSeenMs")
+        if not isinstance(topic, str) or not isinstance(last_seen_ms, (int, float)):
+            continue                 # snapshot written before topics were recorded
+        limits = limits_for_topic(topic)
+        bucket = _buckets[topic] = TokenBucket(limits["rate"], limits["burst"], now)
+        bucket.credit(min(max((wall_ms - last_seen_ms) / 1000, 0.0), CATCHUP_MAX_OUTAGE_S), now)
+
+
+# Uploaded batches (section 8) are paced by the readings' own timestamps, not
+# by arrival: a batch covering ten minutes may carry ten minutes' worth of
+# readings however fast it arrives, but not more.
+_batch_buckets = {}             # topic -> TokenBucket on the reading timeline
+
+
+def admit_batch_reading(topic: str, line_len: int, sampled_s: float) -> bool:
+    """
+    Admission check for one uploaded reading, sampled at sampled_s (epoch s).
+    Same limits and counters as admit_message().
+    """
+    limits = limits_for_topic(topic)
+    if line_len > limits["max_payload"]:
+        admission_stats["oversize"] += 1
+        return False
+
+    bucket = _batch_buckets.get(topic)
+    if bucket is None:
+        if len(_batch_buckets) >= MAX_TRACKED_SOURCES:
+            admission_stats["untracked"] += 1
+            return False
+        bucket = _batch_buckets[topic] = TokenBucket(limits["rate"], limits["burst"], sampled_s)
+
+    if not bucket.try_consume(max(sampled_s, bucket.last)):
+        admission_stats["rate_limited"] += 1
+        return False
+
+    admission_stats["accepted"] += 1
+    return True
+
+
+def report_admission_stats(force: bool = False):
+    """
+    Print a one-line summary of dropped traffic, at most once per interval
+    and only when something was actually dropped.
+    """
+    global _last_admission_report
+    now = time.monotonic()
+    if not force and now - _last_admission_report < ADMISSION_REPORT_INTERVAL_S:
+        return
+    _last_admission_report = now
+
+    dropped = admission_stats["rate_limited"] + admission_stats["oversize"] + admission_stats["untracked"]
+    if dropped == 0:
+        return
+
+    noisy = sorted(((b.dropped, t) for t, b in _buckets.items() if b.dropped), reverse=True)[:3]
+    print(f"[Admission] {admission_stats} top offenders: {[(t, n) for n, t in noisy]}")
+    for bucket in _buckets.values():
+        bucket.dropped = 0
+    for key in admission_stats:
+        admission_stats[key] = 0
+
+
+# --- 5. FIREBASE WRITE PATH (BATCHED) ---
+# on_message() only validates and enqueues; a single writer thread groups
+# queued writes into one multi-path update() per batch. This keeps the paho
+# network loop free, so a session backlog drains at broker speed instead of
+# one Firebase round trip per reading.
+
+BATCH_MAX_ITEMS = 500           # writes per multi-path update
+BATCH_MAX_DELAY_S = 1.0         # max time a write waits in the queue
+WRITE_RETRY_MAX_DELAY_S = 30
+WRITE_QUARANTINE_KEEP = 100      # rejected writes kept in memory for inspection
+WRITER_DRAIN_TIMEOUT_S = 60      # at shutdown; under the 90 s a service manager waits by default
+
+# Raw reading layout (CIRCUIT5_READINGS_LAYOUT):
+#   "samples" - one node per reading under /readings (default)
+#   "blocks"  - packed per device-hour under /readingBlocks (see PACKED HOURLY BLOCKS)
+# read_readings() and the dashboard read both, so the mode can be switched
+# without migrating stored data.
+READINGS_LAYOUT = os.environ.get("CIRCUIT5_READINGS_LAYOUT", "samples")
+
+# A reading taken this long before it arrives is backlog (broker replay or
+# upload); the first history export waits until they stop (section 6)
+BACKLOG_READING_AGE_S = 60
+_last_backlog_reading = 0.0      # monotonic time the last one arrived
+
+_write_queue = queue.Queue()     # (path, value, enqueued_at); path None = barrier
+_alert_queue = queue.Queue()     # alert lane: written one by one, never batched
+_writer_stop = threading.Event()
+write_stats = {"batches": 0, "writes": 0, "readings": 0, "failures": 0, "quarantined": 0}
+quarantined_writes = collections.deque(maxlen=WRITE_QUARANTINE_KEEP)  # (path, value, error)
 
-def store_reading_to_firebase(reading: dict):
+
+class LaneLatency:
+    """
+    Receive-to-stored latency for one lane (ms), kept separately for routine
+    telemetry and the alert lane so the two can be compared.
     """
-    Store a single validated reading into Firebase Realtime Database.
+
+    def __init__(self, name: str):
+        self.name = name
+        self.count = 0
+        self.total_ms = 0.0
+        self.max_ms = 0.0
+
+    def record(self, ms: float):
+        self.count += 1
+        self.total_ms += ms
+        self.max_ms = max(self.max_ms, ms)
+
+    def summary(self) -> str:
+        if self.count == 0:
+            return f"{self.name}: no data"
+        return (f"{self.name}: avg {self.total_ms / self.count:.0f} ms, "
+                f"max {self.max_ms:.0f} ms over {self.count}")
+
+
+telemetry_latency = LaneLatency("telemetry")
+alert_latency = LaneLatency("alert")
+alert_device_latency = LaneLatency("alert (device queue)")
+
+# Firebase push-ID alphabet: keys sort chronologically, same as ref.push()
+_PUSH_CHARS = "-0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz"
+_push_lock = threading.Lock()
+_last_push_ms = 0
+_last_push_rand = [0] * 12
+
+
+def generate_push_id(now_ms: int = None) -> str:
+    """
+    Generate a Firebase-compatible push key locally (no network round trip),
+    so readings can be written as part of a multi-path update.
+    """
+    global _last_push_ms
+    if now_ms is None:
+        now_ms = int(time.time() * 1000)
+
+    with _push_lock:
+        if now_ms == _last_push_ms:
+            # Same millisecond: increment the random suffix to keep ordering
+            for i in range(11, -1, -1):
+                if _last_push_rand[i] != 63:
+                    _last_push_rand[i] += 1
+                    break
+                _last_push_rand[i] = 0
+        else:
+            _last_push_ms = now_ms
+            for i in range(12):
+                _last_push_rand[i] = random.randrange(64)
+        rand = list(_last_push_rand)
+
+    return push_key_prefix(now_ms) + "".join(_PUSH_CHARS[r] for r in rand)
+
+
+def push_key_prefix(ms: int) -> str:
+    """
+    The 8-character time part of a push key, for orderByKey() range reads.
+    """
+    ts_chars = []
+    for _ in range(8):
+        ts_chars.append(_PUSH_CHARS[ms % 64])
+        ms //= 64
+    return "".join(reversed(ts_chars))
+
+
+def store_reading_to_firebase(reading: dict, topic: str = TOPIC, sampled_at: datetime = None):
+    """
+    Queue a single validated reading for the batched writer.
     Structure (example):
 
-    /readings/<deviceId>/<auto-push-id> = {
+    /readings/<deviceId>/<push-id> = {
         timestamp: "...",
         temperature: ...,
         humidity: ...,
         status: "normal"
     }
+
+    sampled_at is when the reading was taken (device timestamp or uploaded
+    batch); without it the reading is stamped on arrival.
     """
+    global _last_backlog_reading
+
     # Attach server-side timestamp (UTC ISO 8601)
-    timestamp = datetime.now(timezone.utc).isoformat()
+    wall = datetime.now(timezone.utc)
+    now = sampled_at or wall
+    timestamp = now.isoformat()
 
     payload = {
         "timestamp": timestamp,
@@ -113,49 +580,1350 @@ def store_reading_to_firebase(reading: dict):
         "status": reading["status"],
     }
 
+    if (wall - now).total_seconds() > BACKLOG_READING_AGE_S:
+        _last_backlog_reading = time.monotonic()
+
     device_id = reading["deviceId"]
+    with _last_seen_lock:
+        # Older than what this device already reported (a backlog uploaded
+        # while it is live again): stored, but must not move its state back
+        late = now < _device_last_seen.get(device_id, now)
+        if not late:
+            _device_last_seen[device_id] = now
+
+    # A reading for a closed day: its history snapshot is exported again
+    if now.date() < wall.date():
+        mark_history_stale(device_id, now)
+
+    # Blocks only take the device's current hour; anything else is stored
+    # per sample, which every reader merges in (see read_readings())
+    if READINGS_LAYOUT == "blocks" and not late and block_key(now) == block_key(wall):
+        append_to_block(device_id, payload, now)
+    else:
+        key = generate_push_id(int(now.timestamp() * 1000))
+
+        # Path: /readings/<deviceId>/...
+        enqueue_write(f"readings/{device_id}/{key}", payload)
+
+    # Secondary indexes maintained at write time
+    alert_started = False
+    if not late:
+        alert_started = update_alert_index(device_id, payload, now)
+        update_latest_snapshot(device_id, payload, reading.get("firmware"), now, topic)
+    update_aggregates(topic, payload, alert_started, now)
+
+
+def enqueue_write(path: str, value):
+    """
+    Queue one path/value pair for the next batched multi-path update.
+    """
+    _write_queue.put((path, value, time.monotonic()))
+
+
+def wait_for_writes(timeout: float = None) -> bool:
+    """
+    Block until every write queued before this call has been written (or
+    quarantined). False on timeout, or if the writes were dropped at shutdown.
+    """
+    done = threading.Event()
+    _write_queue.put((None, done.set, time.monotonic()))
+    return done.wait(timeout)
+
+
+def store_alert_event(alert: dict):
+    """
+    Queue an alert-lane event for immediate (unbatched) writing.
+
+    /alertEvents/<deviceId>/<push-id> = {
+        timestamp: "...", event: "raised", temperature: ..., humidity: ...,
+        seq: 12, queuedMs: 40
+    }
+    """
+    now = datetime.now(timezone.utc)
+    payload = {"timestamp": now.isoformat()}
+    payload.update({k: v for k, v in alert.items() if k != "deviceId" and v is not None})
+    key = generate_push_id(int(now.timestamp() * 1000))
+    _alert_queue.put((f"alertEvents/{alert['deviceId']}/{key}", payload, time.monotonic()))
+    alert_device_latency.record(alert["queuedMs"])
+
+
+# --- LATEST SNAPSHOT ---
+# One small node with the current state of every device, so a fleet overview
+# is a single read (plus one listener) instead of a limitToLast(1) query per
+# device:
+#
+# /latest/<deviceId> = {
+#     temperature: ..., humidity: ..., status: "normal",
+#     lastSeen: "...", lastSeenMs: ..., firmware: "1.4.0",
+#     topic: "hope/iot/..."
+# }
+#
+# Written whole through the batch queue: within a batch only the newest
+# snapshot per device survives (last writer wins).
+
+_device_firmware = {}            # deviceId -> last reported firmware version
+_device_last_seen = {}           # deviceId -> time of its newest stored reading
+_last_seen_lock = threading.Lock()
+
+
+def load_latest_snapshots() -> dict:
+    """
+    The whole of /latest (one read), for resuming per-device state at startup.
+    """
+    try:
+        return db.reference("latest").get() or {}
+    except Exception as e:
+        print("[WARN] Could not load /latest:", e)
+        return {}
+
+
+def update_latest_snapshot(device_id: str, reading: dict, firmware, now: datetime, topic: str):
+    if firmware:
+        _device_firmware[device_id] = firmware
+
+    snapshot = {
+        "temperature": reading["temperature"],
+        "humidity": reading["humidity"],
+        "status": reading["status"],
+        "lastSeen": now.isoformat(),
+        "lastSeenMs": int(now.timestamp() * 1000),
+        "firmware": _device_firmware.get(device_id, "unknown"),
+        "topic": topic,
+    }
+    enqueue_write(f"latest/{device_id}", snapshot)
+
+
+# --- ALERT INDEX ---
+# Status transitions are detected here so "when was this room in alert" is a
+# small indexed read instead of a scan of /readings:
+#
+# /alerts/<deviceId>/events/<push-id> = {
+#     start: "...", end: "..." (absent while open), durationS: ...,
+#     maxTemperature: ..., minTemperature: ..., maxHumidity: ..., readings: n
+# }
+# /alerts/<deviceId>/counts/<YYYY-MM> = number of alerts started that month
+#
+# Writes go through the batch queue; repeated updates to the same path within
+# a batch collapse to the last value, so counts are written as absolute
+# values (this ingester is the only writer) rather than increments.
+#
+# The state is read back once at startup (warm_alert_index()) for every
+# device in /latest, never from on_message(). A device not known then has no
+# open alert and no counts yet.
+
+_alert_state = {}                # deviceId -> open alert dict, or None
+_alert_counts = {}               # (deviceId, "YYYY-MM") -> alerts started
+_alert_state_lock = threading.Lock()
+
+
+def _load_open_alert(device_id: str):
+    """
+    Resume an alert that was still open in the index (one small read).
+    """
+    try:
+        last = (db.reference(f"alerts/{device_id}/events")
+                .order_by_key().limit_to_last(1).get()) or {}
+    except Exception as e:
+        print(f"[WARN] Could not load alert index for {device_id}:", e)
+        return None
+
+    for key, event in last.items():
+        if isinstance(event, dict) and "end" not in event and "start" in event:
+            return {
+                "key": key,
+                "start": datetime.fromisoformat(event["start"]),
+                "maxTemperature": event.get("maxTemperature"),
+                "minTemperature": event.get("minTemperature"),
+                "maxHumidity": event.get("maxHumidity"),
+                "readings": event.get("readings", 0),
+            }
+    return None
+
+
+def _load_alert_count(device_id: str, month: str) -> int:
+    try:
+        return int(db.reference(f"alerts/{device_id}/counts/{month}").get() or 0)
+    except Exception as e:
+        print(f"[WARN] Could not load alert count for {device_id} {month}:", e)
+        return 0
+
+
+def warm_alert_index(latest: dict, now: datetime = None):
+    """
+    At startup, before MQTT connects: load each known device's open alert and
+    its counts for this month and the previous one (a device-timestamped
+    backlog can reach back across the month boundary).
+    """
+    if now is None:
+        now = datetime.now(timezone.utc)
+    months = (now.strftime("%Y-%m"), (now.replace(day=1) - timedelta(days=1)).strftime("%Y-%m"))
+    with _alert_state_lock:
+        for device_id in latest:
+            if not _SEGMENT.match(device_id):
+                continue
+            _alert_state[device_id] = _load_open_alert(device_id)
+            for month in months:
+                _alert_counts[(device_id, month)] = _load_alert_count(device_id, month)
+
+
+def update_alert_index(device_id: str, reading: dict, now: datetime):
+    """
+    Open, extend or close the device's alert record based on this reading.
+    Only "alert" and "normal" change state; "error"/"unknown" are ignored.
+    Returns True if this reading started a new alert.
+    """
+    status = reading["status"]
+    if status not in ("alert", "normal"):
+        return False
+
+    started = False
+
+    with _alert_state_lock:
+        current = _alert_state.get(device_id)
+        base = f"alerts/{device_id}"
+
+        temperature = reading["temperature"]
+        humidity = reading["humidity"]
+
+        if status == "alert":
+            if current is None:
+                current = {
+                    "key": generate_push_id(int(now.timestamp() * 1000)),
+                    "start": now,
+                    "maxTemperature": temperature,
+                    "minTemperature": temperature,
+                    "maxHumidity": humidity,
+                    "readings": 0,
+                }
+                _alert_state[device_id] = current
+                enqueue_write(f"{base}/events/{current['key']}/start", now.isoformat())
+                month = now.strftime("%Y-%m")
+                _alert_counts[(device_id, month)] = _alert_counts.get((device_id, month), 0) + 1
+                enqueue_write(f"{base}/counts/{month}", _alert_counts[(device_id, month)])
+                print(f"[Alerts] {device_id}: alert started")
+                started = True
+
+            current["readings"] += 1
+            current["maxTemperature"] = max(current["maxTemperature"], temperature)
+            current["minTemperature"] = min(current["minTemperature"], temperature)
+            current["maxHumidity"] = max(current["maxHumidity"], humidity)
+
+            event_path = f"{base}/events/{current['key']}"
+            for field in ("maxTemperature", "minTemperature", "maxHumidity", "readings"):
+                enqueue_write(f"{event_path}/{field}", current[field])
+
+        elif current is not None:
+            event_path = f"{base}/events/{current['key']}"
+            enqueue_write(f"{event_path}/end", now.isoformat())
+            enqueue_write(f"{event_path}/durationS",
+                          round((now - current["start"]).total_seconds(), 1))
+            _alert_state[device_id] = None
+            print(f"[Alerts] {device_id}: alert ended")
+
+    return started
+
+
+# --- PACKED HOURLY BLOCKS ---
+# Optional layout for raw readings: one node per device-hour instead of one
+# node (push key, ISO timestamp string, four named fields) per reading.
+#
+# /readingBlocks/<deviceId>/<YYYY-MM-DDTHH> = {
+#     t0: <hour start, epoch ms>,
+#     n: <readings>,
+#     t: "<us since t0>,<delta us>,<delta us>,...",
+#     temperature: "23.4,23.5,...",        (repr: exact float round trip)
+#     humidity: "48.2,48.1,...",
+#     status: "nnnaa..."                   (one character per reading)
+# }
+#
+# While the hour is open each reading is appended as one small leaf,
+# tail/<push-id> = "<us since t0>,<temperature>,<humidity>,<status char>".
+# When the device's next hour starts (or the ticker finds the hour long
+# over) the hour is sealed: the columns are written and the tail removed.
+# Readers use the columns once all are present and the tail otherwise, so
+# a seal split across batches never shows a reading twice. Timestamps keep
+# their microseconds, so read_readings() returns exactly what the
+# per-sample layout stores.
+
+BLOCK_SEAL_GRACE_S = 60          # late sealing of hours whose device went quiet
+_BLOCK_COLUMNS = ("t", "temperature", "humidity", "status", "n")
+_STATUS_CODES = {"normal": "n", "alert": "a", "error": "e", "unknown": "u"}
+_STATUS_NAMES = {code: name for name, code in _STATUS_CODES.items()}
+
+_open_blocks = {}                # deviceId -> open hour (columns kept in memory)
+_blocks_resumed = set()          # devices whose open hour has been read back
+_blocks_lock = threading.Lock()
+
+
+def block_key(at: datetime) -> str:
+    return at.strftime("%Y-%m-%dT%H")
+
+
+def decode_block(node: dict) -> list:
+    """
+    [(us since t0, temperature, humidity, status)] in stored order.
+    """
+    if all(column in node for column in _BLOCK_COLUMNS):
+        offsets, t = [], 0
+        for delta in node["t"].split(","):
+            t += int(delta)
+            offsets.append(t)
+        return list(zip(offsets,
+                        map(float, node["temperature"].split(",")),
+                        map(float, node["humidity"].split(",")),
+                        (_STATUS_NAMES.get(c, "unknown") for c in node["status"])))
+
+    entries = []
+    for _, leaf in sorted((node.get("tail") or {}).items()):
+        off, temperature, humidity, code = leaf.split(",")
+        entries.append((int(off), float(temperature), float(humidity),
+                        _STATUS_NAMES.get(code, "unknown")))
+    return entries
+
+
+def _new_block(hour: datetime) -> dict:
+    return {"key": block_key(hour), "hour": hour, "tail": [],
+            "t": [], "temperature": [], "humidity": [], "status": []}
+
+
+def _load_open_block(device_id: str, hour: datetime) -> dict:
+    """
+    On first sight of a device (e.g. after a restart mid-hour), resume the
+    open hour from the database. One small read per device per process:
+    later hours of the device are started empty in memory.
+    """
+    block = _new_block(hour)
+    try:
+        node = db.reference(f"readingBlocks/{device_id}/{block['key']}").get() or {}
+    except Exception as e:
+        print(f"[WARN] Could not load open block for {device_id}:", e)
+        return block
+
+    for off, temperature, humidity, status in decode_block(node):
+        block["t"].append(off)
+        block["temperature"].append(temperature)
+        block["humidity"].append(humidity)
+        block["status"].append(_STATUS_CODES[status])
+    block["tail"] = list(node.get("tail") or {})
+    return block
+
+
+def append_to_block(device_id: str, reading: dict, now: datetime):
+    hour = now.replace(minute=0, second=0, microsecond=0)
+    with _blocks_lock:
+        block = _open_blocks.get(device_id)
+        if block is None or block["hour"] != hour:
+            if block is not None:
+                _seal_block(device_id, block)
+            if device_id in _blocks_resumed:
+                block = _new_block(hour)
+            else:
+                block = _load_open_block(device_id, hour)
+                _blocks_resumed.add(device_id)
+            _open_blocks[device_id] = block
+
+        off = (now - hour) // timedelta(microseconds=1)
+        code = _STATUS_CODES.get(reading["status"], "u")
+        block["t"].append(off)
+        block["temperature"].append(reading["temperature"])
+        block["humidity"].append(reading["humidity"])
+        block["status"].append(code)
+
+        tail_key = generate_push_id(int(now.timestamp() * 1000))
+        block["tail"].append(tail_key)
+        enqueue_write(f"readingBlocks/{device_id}/{block['key']}/tail/{tail_key}",
+                      f"{off},{reading['temperature']!r},{reading['humidity']!r},{code}")
+
+
+def _seal_block(device_id: str, block: dict):
+    if not block["t"]:
+        return
+    base = f"readingBlocks/{device_id}/{block['key']}"
+    t = block["t"]
+    deltas = [t[0]] + [b - a for a, b in zip(t, t[1:])]
+
+    enqueue_write(f"{base}/t0", int(block["hour"].timestamp() * 1000))
+    enqueue_write(f"{base}/t", ",".join(map(str, deltas)))
+    enqueue_write(f"{base}/temperature", ",".join(map(repr, block["temperature"])))
+    enqueue_write(f"{base}/humidity", ",".join(map(repr, block["humidity"])))
+    enqueue_write(f"{base}/status", "".join(block["status"]))
+    enqueue_write(f"{base}/n", len(t))   # last: readers switch to the columns on n
+    for key in block["tail"]:
+        enqueue_write(f"{base}/tail/{key}", None)
+
+
+def seal_expired_blocks(now: datetime = None):
+    if now is None:
+        now = datetime.now(timezone.utc)
+    with _blocks_lock:
+        for device_id, block in list(_open_blocks.items()):
+            if now >= block["hour"] + timedelta(hours=1, seconds=BLOCK_SEAL_GRACE_S):
+                _seal_block(device_id, block)
+                del _open_blocks[device_id]
+
+
+def read_readings(device_id: str, start_ms: int = None, end_ms: int = None) -> dict:
+    """
+    Raw readings in [start_ms, end_ms) from both layouts, in the per-sample
+    shape {key: {timestamp, temperature, humidity, status}}. Keys of block
+    readings are "<block key>:<index>".
+    """
+    query = db.reference(f"readings/{device_id}").order_by_key()
+    blocks = db.reference(f"readingBlocks/{device_id}").order_by_key()
+    if start_ms is not None:
+        query = query.start_at(push_key_prefix(start_ms))
+        blocks = blocks.start_at(block_key(datetime.fromtimestamp(start_ms / 1000, timezone.utc)))
+    if end_ms is not None:
+        query = query.end_at(push_key_prefix(end_ms))
+        blocks = blocks.end_at(block_key(datetime.fromtimestamp((end_ms - 1) / 1000, timezone.utc)))
+
+    readings = dict(query.get() or {})
+    for key, node in (blocks.get() or {}).items():
+        hour = datetime.strptime(key, "%Y-%m-%dT%H").replace(tzinfo=timezone.utc)
+        hour_ms = int(hour.timestamp() * 1000)
+        for i, (off, temperature, humidity, status) in enumerate(decode_block(node)):
+            ms = hour_ms + off // 1000
+            if (start_ms is not None and ms < start_ms) or (end_ms is not None and ms >= end_ms):
+                continue
+            readings[f"{key}:{i}"] = {
+                "timestamp": (hour + timedelta(microseconds=off)).isoformat(),
+                "temperature": temperature,
+                "humidity": humidity,
+                "status": status,
+            }
+    return readings
+
+
+# --- HIERARCHICAL AGGREGATES ---
+# Tumbling-window statistics above the single device, grouped by the topic
+# hierarchy (hope/iot/<site>/<room>/<device>/telemetry). Each group keeps a
+# running accumulator per open window, so memory is constant per group no
+# matter how many readings arrive. Device clocks differ by a few seconds, so
+# around a boundary a group can have the old and the new window open at
+# once; a reading goes into its own window, and each window is written when
+# its end has passed, as its own series:
+#
+# /aggregates/room/<site>/<room>/<windowKey>
+# /aggregates/site/<site>/<windowKey>
+# /aggregates/fleet/<windowKey> = {
+#     start: "...", end: "...", readings: n, alerts: n,
+#     temperature: {mean, min, max}, humidity: {mean, min, max}
+# }
+#
+# windowKey is the UTC window start as YYYYMMDDTHHMMZ, so keys sort by time
+# and a range is an orderByKey().startAt()/endAt() read.
+#
+# Windows are a live rollup: a reading that arrives after its window has
+# ended (an uploaded backlog) is only counted in late_readings. Raw history
+# still includes it, and if its day was already exported the day's history
+# snapshot is exported again (section 6).
+#
+# On shutdown the open windows are written as they are, and their running
+# state goes to /aggregateState/<series below aggregates>/<windowKey>. The
+# next start resumes the windows still open from there (and removes the
+# node), so a restart inside a window adds to its record instead of
+# overwriting it.
+
+AGGREGATE_WINDOW_S = 300         # 5-minute tumbling windows
+AGGREGATE_TICK_S = 5             # how often idle groups are checked for closed windows
+
+
+class WindowAccumulator:
+    """
+    Running mean/min/max/alert count for one group's open window.
+    """
+    __slots__ = ("window_start", "readings", "alerts",
+                 "t_sum", "t_min", "t_max", "h_sum", "h_min", "h_max")
+
+    def __init__(self, window_start: int):
+        self.window_start = window_start
+        self.readings = 0
+        self.alerts = 0
+        self.t_sum = self.h_sum = 0.0
+        self.t_min = self.h_min = float("inf")
+        self.t_max = self.h_max = float("-inf")
+
+    def add(self, temperature: float, humidity: float, alert_started: bool):
+        self.readings += 1
+        self.t_sum += temperature
+        self.t_min = min(self.t_min, temperature)
+        self.t_max = max(self.t_max, temperature)
+        self.h_sum += humidity
+        self.h_min = min(self.h_min, humidity)
+        self.h_max = max(self.h_max, humidity)
+        if alert_started:
+            self.alerts += 1
+
+    _STATE_FIELDS = {"readings": "readings", "alerts": "alerts",
+                     "tSum": "t_sum", "tMin": "t_min", "tMax": "t_max",
+                     "hSum": "h_sum", "hMin": "h_min", "hMax": "h_max"}
+
+    def to_state(self) -> dict:
+        return {key: getattr(self, attr) for key, attr in self._STATE_FIELDS.items()}
+
+    @classmethod
+    def from_state(cls, window_start: int, state: dict):
+        acc = cls(window_start)
+        for key, attr in cls._STATE_FIELDS.items():
+            setattr(acc, attr, type(getattr(acc, attr))(state[key]))
+        return acc
+
+    def to_record(self) -> dict:
+        start = datetime.fromtimestamp(self.window_start, timezone.utc)
+        end = datetime.fromtimestamp(self.window_start + AGGREGATE_WINDOW_S, timezone.utc)
+        return {
+            "start": start.isoformat(),
+            "end": end.isoformat(),
+            "readings": self.readings,
+            "alerts": self.alerts,
+            "temperature": {"mean": round(self.t_sum / self.readings, 2),
+                            "min": self.t_min, "max": self.t_max},
+            "humidity": {"mean": round(self.h_sum / self.readings, 2),
+                         "min": self.h_min, "max": self.h_max},
+        }
+
+
+_aggregates = {}                 # (series path, window start) -> WindowAccumulator (open window)
+_aggregates_lock = threading.Lock()
+aggregate_stats = {"windows_written": 0, "late_readings": 0}
+
+
+def aggregate_groups(topic: str):
+    """
+    Series paths a reading on this topic contributes to: room, site, fleet.
+    The topic has passed valid_topic() (MQTT) or the upload path check.
+    """
+    parts = topic.split("/")
+    site, room = parts[2], parts[3]
+    return (f"aggregates/room/{site}/{room}",
+            f"aggregates/site/{site}",
+            "aggregates/fleet")
+
+
+def _window_key(window_start: int) -> str:
+    return datetime.fromtimestamp(window_start, timezone.utc).strftime("%Y%m%dT%H%MZ")
+
+
+def _close_window(series: str, acc: WindowAccumulator):
+    enqueue_write(f"{series}/{_window_key(acc.window_start)}", acc.to_record())
+    aggregate_stats["windows_written"] += 1
+
+
+def _state_path(series: str, window_start: int) -> str:
+    return f"aggregateState/{series[len('aggregates/'):]}/{_window_key(window_start)}"
+
+
+def update_aggregates(topic: str, reading: dict, alert_started: bool, now: datetime):
+    """
+    Fold one reading into its window in every group above its device. The
+    window is created on first use; close_expired_windows() writes it.
+    """
+    now_s = int(now.timestamp())
+    window_start = now_s - now_s % AGGREGATE_WINDOW_S
+
+    with _aggregates_lock:
+        # Under the lock, so the ticker cannot close the window in between
+        if window_start + AGGREGATE_WINDOW_S <= time.time():
+            aggregate_stats["late_readings"] += 1
+            return
+        for series in aggregate_groups(topic):
+            acc = _aggregates.get((series, window_start))
+            if acc is None:
+                acc = _aggregates[(series, window_start)] = WindowAccumulator(window_start)
+            acc.add(reading["temperature"], reading["humidity"], alert_started)
+
+
+def close_expired_windows(now_s: float = None, force: bool = False):
+    """
+    Write windows whose end has passed, whether or not newer readings have
+    arrived for their group. On shutdown (force) every open window is
+    written as it is and its state saved for the next start.
+    """
+    if now_s is None:
+        now_s = time.time()
+    with _aggregates_lock:
+        for key, acc in list(_aggregates.items()):
+            ended = now_s >= acc.window_start + AGGREGATE_WINDOW_S
+            if force or ended:
+                series = key[0]
+                if acc.readings:
+                    _close_window(series, acc)
+                    if not ended:
+                        enqueue_write(_state_path(series, acc.window_start), acc.to_state())
+                del _aggregates[key]
+
+
+def resume_open_windows(now_s: float = None):
+    """
+    Startup: take back the windows saved at the last shutdown that are still
+    open. Windows that ended meanwhile keep the record written then.
+    """
+    if now_s is None:
+        now_s = time.time()
+    try:
+        saved = db.reference("aggregateState").get() or {}
+    except Exception as e:
+        print("[WARN] Could not load open aggregate windows:", e)
+        return
+
+    resumed = 0
+
+    def walk(node: dict, series: str):
+        nonlocal resumed
+        for key, child in node.items():
+            if not isinstance(child, dict):
+                continue
+            if "readings" not in child:
+                walk(child, f"{series}/{key}")
+                continue
+            # Each entry is used once; removed leaf by leaf so a later save
+            # to the same path never shares a batch with a delete of its parent
+            enqueue_write(f"aggregateState/{series[len('aggregates/'):]}/{key}", None)
+            try:
+                start = datetime.strptime(key, "%Y%m%dT%H%MZ").replace(tzinfo=timezone.utc)
+                window_start = int(start.timestamp())
+                acc = WindowAccumulator.from_state(window_start, child)
+            except (KeyError, TypeError, ValueError):
+                continue
+            if now_s < window_start + AGGREGATE_WINDOW_S:
+                _aggregates[(series, window_start)] = acc
+                resumed += 1
+
+    with _aggregates_lock:
+        walk(saved, "aggregates")
+    print(f"[System] Resumed {resumed} open aggregate windows")
+
+
+def aggregate_ticker_loop():
+    while not _writer_stop.wait(AGGREGATE_TICK_S):
+        close_expired_windows()
+        seal_expired_blocks()
+
+
+def flush_batch_to_firebase(updates: dict):
+    """
+    Write one batch as a single multi-path update at the database root.
+    Raises on failure so the caller can retry the same batch.
+    """
+    db.reference().update(updates)
+
+
+def _collect_batch(first_item):
+    """
+    Returns (updates, oldest enqueue time, barrier callback or None) for one
+    batch. A barrier (see wait_for_writes()) ends the batch early, so whoever
+    waits on it is not held up by BATCH_MAX_DELAY_S.
+    """
+    updates = {}
+    oldest = first_item[2]
+    deadline = time.monotonic() + BATCH_MAX_DELAY_S
+    path, value, _ = first_item
+    while True:
+        if path is None:
+            return updates, oldest, value
+        updates[path] = value
+        if len(updates) >= BATCH_MAX_ITEMS:
+            return updates, oldest, None
+
+        # Drain whatever is already queued without waiting (backlog case)
+        try:
+            path, value, _ = _write_queue.get_nowait()
+        except queue.Empty:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0 or _writer_stop.is_set():
+                return updates, oldest, None
+            try:
+                path, value, _ = _write_queue.get(timeout=remaining)
+            except queue.Empty:
+                return updates, oldest, None
+
+
+def _is_rejected_write(e: Exception) -> bool:
+    """
+    True if the database refused the data itself (invalid key, a path and
+    its ancestor in one update, ...): retrying the same batch cannot succeed.
+    """
+    return isinstance(e, (ValueError, TypeError, firebase_exceptions.InvalidArgumentError))
+
+
+def _write_batch(updates: dict) -> bool:
+    """
+    Write one batch. Transient failures are retried with backoff (the batch
+    is kept, so a Firebase blip does not drop readings). A batch the database
+    rejects is split in halves until the offending writes are isolated;
+    those are quarantined and everything else is written. Returns False only
+    if the batch was dropped at shutdown.
+    """
+    retry_delay = 1
+    while True:
+        try:
+            flush_batch_to_firebase(updates)
+            write_stats["batches"] += 1
+            write_stats["writes"] += len(updates)
+            write_stats["readings"] += sum(
+                1 for p, v in updates.items()
+                if p.startswith("readings/") or ("/tail/" in p and v is not None))
+            return True
+        except Exception as e:
+            if _is_rejected_write(e):
+                if len(updates) == 1:
+                    (path, value), = updates.items()
+                    quarantined_writes.append((path, value, str(e)))
+                    write_stats["quarantined"] += 1
+                    print(f"[ERROR] Write to {path} rejected, quarantined and dropped:", e)
+                    return True
+                items = list(updates.items())
+                half = len(items) // 2
+                first = _write_batch(dict(items[:half]))
+                return _write_batch(dict(items[half:])) and first
+
+            write_stats["failures"] += 1
+            print(f"[ERROR] Batch write failed ({len(updates)} items), "
+                  f"retrying in {retry_delay}s:", e)
+            if _writer_stop.is_set() and retry_delay >= WRITE_RETRY_MAX_DELAY_S:
+                print("[ERROR] Shutting down with unwritten batch, dropping it.")
+                return False
+            time.sleep(retry_delay)
+            retry_delay = min(retry_delay * 2, WRITE_RETRY_MAX_DELAY_S)
+
+
+def firebase_writer_loop():
+    """
+    Writer thread: batch queued writes into multi-path updates.
+    """
+    while not (_writer_stop.is_set() and _write_queue.empty()):
+        try:
+            first = _write_queue.get(timeout=0.5)
+        except queue.Empty:
+            continue
+
+        updates, oldest, barrier = _collect_batch(first)
+        if updates:
+            if not _write_batch(updates):
+                continue             # dropped at shutdown: the barrier stays unreleased
+            telemetry_latency.record((time.monotonic() - oldest) * 1000)
+            print(f"[Firebase] Wrote batch of {len(updates)} "
+                  f"(queued: {_write_queue.qsize()})")
+        if barrier is not None:
+            barrier()
+
+
+def alert_writer_loop():
+    """
+    Alert-lane writer: one write per event as soon as it arrives, so alerts
+    never wait behind a telemetry batch or a backlog drain.
+    """
+    while not (_writer_stop.is_set() and _alert_queue.empty()):
+        try:
+            path, value, received_at = _alert_queue.get(timeout=0.5)
+        except queue.Empty:
+            continue
 
-    # Path: /readings/<deviceId>/...
-    ref = db.reference(f"readings/{device_id}")
-    new_ref = ref.push(payload)
+        for attempt in range(5):
+            try:
+                db.reference(path).set(value)
+                alert_latency.record((time.monotonic() - received_at) * 1000)
+                print(f"[Firebase] Stored alert {value.get('event')} at {path} "
+                      f"({alert_latency.summary()}; {alert_device_latency.summary()}; "
+                      f"{telemetry_latency.summary()})")
+                break
+            except Exception as e:
+                print(f"[ERROR] Alert write failed (attempt {attempt + 1}):", e)
+                time.sleep(0.5 * (attempt + 1))
 
-    print(f"[Firebase] Stored reading under key {new_ref.key}: {payload}")
+
+def start_firebase_writer():
+    """
+    Start the batched telemetry writer and the alert-lane writer.
+    Returns the threads, to be passed to stop_firebase_writer().
+    """
+    _writer_stop.clear()
+    writers = [
+        threading.Thread(target=firebase_writer_loop, name="firebase-writer", daemon=True),
+        threading.Thread(target=alert_writer_loop, name="alert-writer", daemon=True),
+        threading.Thread(target=aggregate_ticker_loop, name="aggregate-ticker", daemon=True),
+    ]
+    if SNAPSHOT_DIR:
+        writers.append(threading.Thread(target=history_snapshot_loop,
+                                        name="history-snapshots", daemon=True))
+    for writer in writers:
+        writer.start()
+    return writers
+
+
+def stop_firebase_writer(writers, timeout: float = WRITER_DRAIN_TIMEOUT_S):
+    """
+    Flush anything still queued, then stop the writer threads. The open
+    aggregate windows are written as partial windows (and resumed by the
+    next start).
+    """
+    close_expired_windows(force=True)
+    _writer_stop.set()
+    deadline = time.monotonic() + timeout
+    for writer in writers:
+        writer.join(max(0.0, deadline - time.monotonic()))
+    if not _write_queue.empty():
+        print(f"[ERROR] Exiting with {_write_queue.qsize()} writes still queued.")
+
+
+# --- 6. HISTORY SNAPSHOTS (STATIC, CDN-CACHEABLE) ---
+# A closed period (a finished UTC day or month) never changes, so instead of
+# every dashboard viewer querying Firebase for it, it is exported once as a
+# small gzip'd JSON file that is deployed with the dashboard:
+#
+# deploy-dashboard/history/manifest.json                           (no-cache)
+# deploy-dashboard/history/snapshots/<deviceId>/<period>.<hash>.json.gz  (immutable)
+#
+# A snapshot holds the period's hourly buckets, which is what the history
+# chart plots, as parallel arrays:
+#
+# {"v": 1, "device": "...", "period": "2026-10-17",
+#  "hours": {"t": [hour start ms], "n": [...], "tSum": [...], "hSum": [...],
+#            "tMin": [...], "tMax": [...], "hMin": [...], "hMax": [...]}}
+#
+# The file name carries a hash of the content, so it can be cached forever.
+# The manifest maps each device's periods to files (null = no readings that
+# period); the dashboard only queries Firebase from the first period the
+# manifest does not cover. Months are merged from their day snapshots once
+# every day of the month has been exported.
+#
+# The files are build output (git-ignored). The first export after startup
+# waits until the broker has replayed the session backlog and it is stored,
+# so a day is never frozen without the readings queued during the outage.
+# A reading that still arrives for an exported day (an upload after an
+# outage across midnight) marks the day stale; the next run exports it, and
+# its month if that was merged already, again under a new hash.
+
+SNAPSHOT_DIR = os.environ.get(
+    "CIRCUIT5_HISTORY_DIR",
+    os.path.join(os.path.dirname(os.path.abspath(__file__)), "deploy-dashboard", "history"))
+SNAPSHOT_INTERVAL_S = 3600       # check for newly closed periods hourly
+SNAPSHOT_SETTLE_S = 30           # no backlog readings for this long = drained
+SNAPSHOT_BACKFILL_DAYS = 62      # closed days considered (covers the previous month)
+SNAPSHOT_FLUSH_WAIT_S = 60       # for late readings to be written before re-exporting
+_HOUR_FIELDS = ("n", "tSum", "hSum", "tMin", "tMax", "hMin", "hMax")
+
+_stale_history = set()           # (deviceId, "YYYY-MM-DD") with late readings
+_stale_history_lock = threading.Lock()
+
+
+def mark_history_stale(device_id: str, at: datetime):
+    if SNAPSHOT_DIR:
+        with _stale_history_lock:
+            _stale_history.add((device_id, at.strftime("%Y-%m-%d")))
+
+
+def _bucket_readings_by_hour(readings: dict) -> dict:
+    """
+    {hour start ms: [n, tSum, hSum, tMin, tMax, hMin, hMax]} for raw readings.
+    """
+    hours = {}
+    for value in readings.values():
+        try:
+            t = int(datetime.fromisoformat(value["timestamp"]).timestamp() * 1000)
+            temperature = float(value["temperature"])
+            humidity = float(value["humidity"])
+        except (KeyError, TypeError, ValueError):
+            continue
+        hour = t - t % 3_600_000
+        b = hours.get(hour)
+        if b is None:
+            hours[hour] = [1, temperature, humidity, temperature, temperature, humidity, humidity]
+        else:
+            b[0] += 1
+            b[1] += temperature
+            b[2] += humidity
+            b[3] = min(b[3], temperature)
+            b[4] = max(b[4], temperature)
+            b[5] = min(b[5], humidity)
+            b[6] = max(b[6], humidity)
+    return hours
+
+
+def _write_snapshot(device_id: str, period: str, hours: dict) -> str:
+    """
+    Write one immutable snapshot, returning its path relative to SNAPSHOT_DIR.
+    """
+    ordered = sorted(hours)
+    doc = {"v": 1, "device": device_id, "period": period,
+           "hours": {"t": ordered}}
+    for i, field in enumerate(_HOUR_FIELDS):
+        doc["hours"][field] = [round(hours[h][i], 2) for h in ordered]
+
+    # mtime=0 keeps the gzip bytes (and so the name) a pure function of the content
+    body = gzip.compress(json.dumps(doc, separators=(",", ":")).encode(), mtime=0)
+    digest = hashlib.sha256(body).hexdigest()[:12]
+    rel = f"snapshots/{device_id}/{period}.{digest}.json.gz"
+    path = os.path.join(SNAPSHOT_DIR, rel)
+    if not os.path.exists(path):
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path + ".tmp", "wb") as f:
+            f.write(body)
+        os.replace(path + ".tmp", path)
+    return rel
+
+
+def _read_snapshot_hours(rel: str) -> dict:
+    with gzip.open(os.path.join(SNAPSHOT_DIR, rel)) as f:
+        cols = json.load(f)["hours"]
+    return {t: [cols[field][i] for field in _HOUR_FIELDS] for i, t in enumerate(cols["t"])}
+
+
+def load_history_manifest() -> dict:
+    try:
+        with open(os.path.join(SNAPSHOT_DIR, "manifest.json")) as f:
+            return json.load(f)
+    except (OSError, ValueError):
+        return {"v": 1, "devices": {}}
+
+
+def _save_history_manifest(manifest: dict):
+    manifest["generatedAt"] = datetime.now(timezone.utc).isoformat()
+    path = os.path.join(SNAPSHOT_DIR, "manifest.json")
+    os.makedirs(SNAPSHOT_DIR, exist_ok=True)
+    with open(path + ".tmp", "w") as f:
+        json.dump(manifest, f, separators=(",", ":"), sort_keys=True)
+    os.replace(path + ".tmp", path)
 
 
-# --- 5. MQTT CALLBACKS ---
+def export_day_snapshot(device_id: str, day: datetime):
+    """
+    Export one closed UTC day. Returns the snapshot path, or None if the
+    device has no readings that day.
+    """
+    start_ms = int(day.timestamp() * 1000)
+    end_ms = start_ms + 86_400_000
+    hours = _bucket_readings_by_hour(read_readings(device_id, start_ms, end_ms))
+    if not hours:
+        return None
+    return _write_snapshot(device_id, day.strftime("%Y-%m-%d"), hours)
+
+
+def _merge_month(device_id: str, month: str, days: dict):
+    hours = {}
+    for period, rel in days.items():
+        if period.startswith(month) and rel:
+            hours.update(_read_snapshot_hours(rel))
+    return _write_snapshot(device_id, month, hours) if hours else None
+
+
+def export_history_snapshots(now: datetime = None):
+    """
+    Export every closed day (within the backfill window) and closed month not
+    yet in the manifest, then rewrite the manifest.
+    """
+    if now is None:
+        now = datetime.now(timezone.utc)
+    today = now.replace(hour=0, minute=0, second=0, microsecond=0)
+    first_day = today - timedelta(days=SNAPSHOT_BACKFILL_DAYS)
+
+    # Late readings marked so far must be in the database before their days
+    # are read again; if the writer is stuck they wait for the next run
+    with _stale_history_lock:
+        stale = set(_stale_history)
+        _stale_history.clear()
+    if stale and not wait_for_writes(SNAPSHOT_FLUSH_WAIT_S):
+        with _stale_history_lock:
+            _stale_history.update(stale)
+        stale = set()
+
+    devices = db.reference("latest").get(shallow=True) or {}
+    manifest = load_history_manifest()
+    exported = 0
+
+    for device_id in sorted(devices):
+        entry = manifest["devices"].setdefault(device_id, {"days": {}, "months": {}})
+        days, months = entry["days"], entry["months"]
+
+        # Dropping the entries makes the loops below export them again (a
+        # month's day entries are gone once it is merged, so all its days are)
+        for stale_device, period in stale:
+            if stale_device == device_id:
+                days.pop(period, None)
+                months.pop(period[:7], None)
+
+        day = first_day
+        while day < today:
+            period = day.strftime("%Y-%m-%d")
+            if period not in days and day.strftime("%Y-%m") not in months:
+                days[period] = export_day_snapshot(device_id, day)
+                exported += 1
+            day += timedelta(days=1)
+
+        # Closed months whose every day has been exported
+        month_start = first_day.replace(day=1)
+        current_month = today.strftime("%Y-%m")
+        while month_start.strftime("%Y-%m") != current_month:
+            month = month_start.strftime("%Y-%m")
+            next_month = (month_start + timedelta(days=32)).replace(day=1)
+            n_days = (next_month - month_start).days
+            covered = sum(1 for p in days if p.startswith(month))
+            if month not in months and covered == n_days:
+                months[month] = _merge_month(device_id, month, days)
+                exported += 1
+            month_start = next_month
+
+        # Day entries that a month snapshot covers, or that fell out of the
+        # backfill window, are no longer needed by the dashboard
+        oldest = first_day.strftime("%Y-%m-%d")
+        for period in list(days):
+            if period[:7] in months or period < oldest:
+                del days[period]
+
+    _save_history_manifest(manifest)
+    if exported:
+        print(f"[History] Exported {exported} snapshot period(s) to {SNAPSHOT_DIR}")
+
+
+def wait_for_backlog_drain() -> bool:
+    """
+    Block until MQTT has connected and the backlog it replays is stored: no
+    backlog reading for SNAPSHOT_SETTLE_S and nothing left in the write
+    queue. Returns False if the writers are stopping.
+    """
+    while not _writer_stop.is_set():
+        if _mqtt_ready.is_set():
+            quiet_since = max(_connected_at, _last_backlog_reading)
+            if time.monotonic() - quiet_since >= SNAPSHOT_SETTLE_S and _write_queue.empty():
+                return True
+        _writer_stop.wait(1)
+    return False
+
+
+def history_snapshot_loop():
+    if not wait_for_backlog_drain():
+        return
+    print("[History] Backlog stored, exporting closed periods")
+    while True:
+        try:
+            export_history_snapshots()
+        except Exception as e:
+            print("[ERROR] History snapshot export failed:", e)
+        if _writer_stop.wait(SNAPSHOT_INTERVAL_S):
+            break
+
+
+# --- 7. MQTT CALLBACKS ---
+
+_disconnected_at = None          # monotonic time of last disconnect
+_connected_at = 0.0              # monotonic time of last successful connect
+_mqtt_ready = threading.Event()  # set once connected and subscribed
+
 
 def on_connect(client, userdata, flags, rc):
+    global _connected_at
     print("[MQTT] Connected with result code", rc)
     if rc == 0:
-        print(f"[MQTT] Subscribing to topic: {TOPIC}")
-        client.subscribe(TOPIC, qos=0)
+        _connected_at = time.monotonic()
+        session_present = bool(flags.get("session present"))
+        if session_present:
+            # Broker is about to replay what it queued while we were away.
+            # After a process restart the sources were credited at startup
+            # (seed_known_sources()).
+            if _disconnected_at is not None:
+                outage = time.monotonic() - _disconnected_at
+                print(f"[MQTT] Resumed persistent session (outage ~{outage:.0f}s), draining backlog...")
+                credit_outage(outage)
+            else:
+                print("[MQTT] Resumed persistent session, draining backlog...")
+        # Subscribing again is harmless when the session already has it
+        print(f"[MQTT] Subscribing to topics: {', '.join(f for f, _ in SUBSCRIPTIONS)} "
+              f"(QoS {SUBSCRIBE_QOS})")
+        client.unsubscribe(STALE_FILTERS)
+        client.subscribe(SUBSCRIPTIONS)
+        _mqtt_ready.set()
     else:
         print("[MQTT] Connection failed.")
 
 
+def on_disconnect(client, userdata, rc):
+    global _disconnected_at
+    _disconnected_at = time.monotonic()
+    print("[MQTT] Disconnected with result code", rc)
+
+
 def on_message(client, userdata, msg):
+    # Cheap site and admission checks first: no decoding or logging for
+    # dropped traffic (other sites can still arrive from a stale filter
+    # while the broker applies the unsubscribe)
+    if not topic_in_sites(msg.topic):
+        return
+    if not admit_message(msg.topic, len(msg.payload)):
+        report_admission_stats()
+        return
+
+    if not valid_topic(msg.topic):
+        print("[WARN] Unusable topic, ignoring:", msg.topic)
+        return
+
     payload_str = msg.payload.decode(errors="ignore")
     print(f"[MQTT] Received on {msg.topic}: {payload_str}")
 
+    if msg.topic.endswith("/alert"):
+        alert = parse_alert_payload(payload_str)
+        if alert is not None:
+            store_alert_event(alert)
+        return
+
     reading = parse_and_validate_payload(payload_str)
     if reading is None:
         # Invalid / malicious / garbage payload
         return
 
+    # Only enqueues; the writer thread batches the actual Firebase write
+    store_reading_to_firebase(reading, msg.topic, reading["sampledAt"])
+
+
+# --- 8. HTTP BATCH UPLOAD (FALLBACK TRANSPORT) ---
+# A board that cannot reach the broker but can reach this host buffers its
+# readings and uploads them here (Sketch/BatchUpload.cpp):
+#
+#   POST /ingest/<site>/<room>/<device>   (-> hope/iot/<site>/<room>/<device>/telemetry)
+#   Authorization: Bearer <CIRCUIT5_BATCH_TOKEN>
+#   X-Device-Id: uno-r4-living-room       (<device>-<room>, or just <device>)
+#   X-Boot-Id: 3f9a01c2                   (sequence numbers restart at boot)
+#   X-Firmware: 1.4.0                     (optional)
+#   Transfer-Encoding: chunked            (or Content-Length)
+#   Content-Encoding: gzip                (optional)
+#
+#   <seq>,<age ms>,<temperature>,<humidity>,<status char>\n   one line per reading
+#
+# Each line goes through validate_reading() and store_reading_to_firebase()
+# like MQTT telemetry, stamped with the time it was taken (arrival minus
+# age). The reply is {"boot": ..., "ack": <highest sequence written to the
+# database>}: it waits (up to BATCH_ACK_WAIT_S) for the batch holding the
+# readings to be flushed, because the device drops everything up to ack and
+# resumes after it. Lines already received are skipped, so a POST cut off
+# half way, or re-sent after a short ack, is not stored twice. The received
+# sequence is kept at /uploads/<deviceId> and written in the same batches as
+# the readings, so after a restart it is only as far as what was written.
+#
+# The endpoint writes to the same database as MQTT telemetry, so it is off
+# unless CIRCUIT5_BATCH_PORT is set, and it refuses to start without a
+# shared token (CIRCUIT5_BATCH_TOKEN, also set in the sketch). It listens on
+# CIRCUIT5_BATCH_BIND: loopback by default, the host's LAN address for boards.
+
+BATCH_UPLOAD_PORT = int(os.environ.get("CIRCUIT5_BATCH_PORT", "0"))  # 0 disables (e.g. 8088)
+BATCH_UPLOAD_BIND = os.environ.get("CIRCUIT5_BATCH_BIND", "127.0.0.1")
+BATCH_UPLOAD_TOKEN = os.environ.get("CIRCUIT5_BATCH_TOKEN", "")
+BATCH_MAX_BODY = 256 * 1024      # decoded bytes per request
+BATCH_READ_TIMEOUT_S = 10        # per socket read, so a stalled board can't hold a thread
+BATCH_ACK_WAIT_S = 4             # under the board's 5 s RESPONSE_TIMEOUT_MS
+
+_upload_acks = {}                # deviceId -> {"boot": ..., "seq": received, "acked": written}
+_upload_locks = {}               # deviceId -> lock (one batch per device at a time)
+_upload_locks_guard = threading.Lock()
+upload_stats = {"requests": 0, "stored": 0, "duplicates": 0, "rejected": 0}
+
+
+def _load_upload_ack(device_id: str) -> dict:
+    """
+    On first upload from a device (e.g. after a restart), resume its ack.
+    """
     try:
-        store_reading_to_firebase(reading)
+        node = db.reference(f"uploads/{device_id}").get() or {}
     except Exception as e:
-        print("[ERROR] Failed to store reading to Firebase:", e)
+        print(f"[WARN] Could not load upload ack for {device_id}:", e)
+        node = {}
+    seq = int(node.get("seq", 0))
+    return {"boot": node.get("boot"), "seq": seq, "acked": seq}
 
 
-# --- 6. MAIN ENTRYPOINT ---
+def ingest_batch(topic: str, device_id: str, boot: str, firmware, lines) -> int:
+    """
+    Validate and store the readings of one upload (lines may be a generator
+    over the request body). Returns the ack for the device: the highest
+    sequence number whose reading is in the database.
+    """
+    with _upload_locks_guard:
+        lock = _upload_locks.setdefault(device_id, threading.Lock())
+
+    with lock:
+        state = _upload_acks.get(device_id)
+        if state is None:
+            state = _upload_acks[device_id] = _load_upload_ack(device_id)
+        if state["boot"] != boot:
+            state["boot"], state["seq"], state["acked"] = boot, 0, 0
+            enqueue_write(f"uploads/{device_id}", {"boot": boot, "seq": 0})
+        first_seq = state["seq"]
+
+        try:
+            for line in lines:
+                arrived = datetime.now(timezone.utc)
+                try:
+                    seq, age_ms, temperature, humidity, code = line.decode().strip().split(",")
+                    seq, age_ms = int(seq), max(0, int(age_ms))
+                except ValueError:
+                    upload_stats["rejected"] += 1
+                    continue
+                if seq <= state["seq"]:
+                    upload_stats["duplicates"] += 1
+                    continue
+                state["seq"] = seq
+
+                sampled_at = arrived - timedelta(milliseconds=age_ms)
+                if not admit_batch_reading(topic, len(line), sampled_at.timestamp()):
+                    upload_stats["rejected"] += 1
+                    continue
+                reading = validate_reading({
+                    "deviceId": device_id,
+                    "temperature": temperature,
+                    "humidity": humidity,
+                    "status": _STATUS_NAMES.get(code, "unknown"),
+                    "fw": firmware,
+                })
+                if reading is None:
+                    upload_stats["rejected"] += 1
+                    continue
+                store_reading_to_firebase(reading, topic, sampled_at)
+                upload_stats["stored"] += 1
+        finally:
+            # Also on a body cut off half way: what was read is not stored twice
+            if state["seq"] != first_seq:
+                enqueue_write(f"uploads/{device_id}", {"boot": boot, "seq": state["seq"]})
+
+        # Everything received so far (this batch and any earlier one that
+        # was still queued) is acked once it has been written
+        if state["acked"] < state["seq"]:
+            received = state["seq"]
+            if wait_for_writes(BATCH_ACK_WAIT_S):
+                state["acked"] = received
+        return state["acked"]
+
+
+class BatchUploadHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    timeout = BATCH_READ_TIMEOUT_S
+
+    def do_POST(self):
+        auth = self.headers.get("Authorization", "")
+        if not (BATCH_UPLOAD_TOKEN and hmac.compare_digest(
+                auth.encode(), f"Bearer {BATCH_UPLOAD_TOKEN}".encode())):
+            self._reply(401, {"error": "missing or wrong upload token"})
+            return
+
+        parts = self.path.split("?")[0].strip("/").split("/")
+        device_id = self.headers.get("X-Device-Id", "")
+        boot = self.headers.get("X-Boot-Id", "")
+        if len(parts) != 4 or parts[0] != "ingest" or not all(
+                _SEGMENT.match(p) for p in parts[1:] + [device_id, boot]):
+            self._reply(400, {"error": "expected POST /ingest/<site>/<room>/<device> "
+                                       "with X-Device-Id and X-Boot-Id"})
+            return
+        if parts[1] not in SITES:
+            self._reply(404, {"error": f"unknown site {parts[1]}"})
+            return
+        if device_id not in (f"{parts[3]}-{parts[2]}", parts[3]):
+            self._reply(403, {"error": f"X-Device-Id {device_id} does not match the path"})
+            return
+
+        upload_stats["requests"] += 1
+        topic = f"hope/iot/{parts[1]}/{parts[2]}/{parts[3]}/telemetry"
+        firmware = self.headers.get("X-Firmware")
+        before = dict(upload_stats)
+        try:
+            ack = ingest_batch(topic, device_id, boot, firmware, self._body_lines())
+        except (OSError, ValueError, zlib.error) as e:
+            # Connection dropped or body malformed: the device retries from its ack
+            print(f"[Upload] {device_id}: batch cut short ({e})")
+            self.close_connection = True
+            return
+
+        print(f"[Upload] {device_id}: {upload_stats['stored'] - before['stored']} stored, "
+              f"{upload_stats['duplicates'] - before['duplicates']} duplicate, "
+              f"{upload_stats['rejected'] - before['rejected']} rejected, ack {ack}")
+        self._reply(200, {"boot": boot, "ack": ack})
+
+    def _reply(self, code: int, body: dict):
+        data = json.dumps(body).encode()
+        self.send_response(code)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        self.send_header("Connection", "close")
+        self.end_headers()
+        self.wfile.write(data)
+        self.close_connection = True
+
+    def _body_chunks(self):
+        if "chunked" in self.headers.get("Transfer-Encoding", "").lower():
+            while True:
+                size = int(self.rfile.readline(64).split(b";")[0].strip() or b"x", 16)
+                if size == 0:
+                    self.rfile.readline(64)          # blank line after the last chunk
+                    return
+                data = self.rfile.read(size)
+                if len(data) < size or self.rfile.readline(64).strip():
+                    raise ValueError("truncated chunk")
+                yield data
+        else:
+            remaining = int(self.headers.get("Content-Length") or 0)
+            while remaining > 0:
+                data = self.rfile.read(min(remaining, 16384))
+                if not data:
+                    raise ValueError("truncated body")
+                remaining -= len(data)
+                yield data
+
+    def _body_lines(self):
+        """
+        Complete lines of the (possibly gzip'd) body as they arrive, so a
+        body cut off half way still yields everything before the cut.
+        """
+        gzipped = "gzip" in self.headers.get("Content-Encoding", "").lower()
+        inflate = zlib.decompressobj(16 + zlib.MAX_WBITS) if gzipped else None
+        pending, total = b"", 0
+        for data in self._body_chunks():
+            if inflate is not None:
+                data = inflate.decompress(data, BATCH_MAX_BODY - total + 1)
+                if inflate.unconsumed_tail:
+                    raise ValueError("body too large")
+            total += len(data)
+            if total > BATCH_MAX_BODY:
+                raise ValueError("body too large")
+            *lines, pending = (pending + data).split(b"\n")
+            yield from (line for line in lines if line.strip())
+        if pending.strip():
+            yield pending
+
+    def log_message(self, format, *args):
+        pass                         # one [Upload] line per batch instead
+
+
+def start_batch_upload_server():
+    server = ThreadingHTTPServer((BATCH_UPLOAD_BIND, BATCH_UPLOAD_PORT), BatchUploadHandler)
+    server.daemon_threads = True
+    threading.Thread(target=server.serve_forever, name="batch-upload", daemon=True).start()
+    return server
+
+
+# --- 9. MAIN ENTRYPOINT ---
 
 def main():
     print("[System] Initialising Firebase...")
     init_firebase()
 
+    # Devices seen before this restart: their broker backlog is credited and
+    # their alert state is loaded here, not on the MQTT thread
+    latest = load_latest_snapshots()
+    seed_known_sources(latest)
+    warm_alert_index(latest)
+    resume_open_windows()
+
+    print("[System] Starting Firebase writer threads...")
+    writer = start_firebase_writer()
+
+    upload_server = None
+    if BATCH_UPLOAD_PORT and not BATCH_UPLOAD_TOKEN:
+        print("[ERROR] CIRCUIT5_BATCH_PORT is set but CIRCUIT5_BATCH_TOKEN is not; "
+              "batch uploads stay off.")
+    elif BATCH_UPLOAD_PORT:
+        print(f"[System] Accepting batch uploads on "
+              f"http://{BATCH_UPLOAD_BIND}:{BATCH_UPLOAD_PORT}/ingest/...")
+        upload_server = start_batch_upload_server()
+
     print("[System] Connecting to MQTT broker...")
-    client = mqtt.Client()
+    # Fixed client ID + clean_session=False = persistent session on the broker
+    client = mqtt.Client(client_id=INGESTER_CLIENT_ID, clean_session=False)
 
     # NOTE: we are using public broker.hivemq.com:1883 with no auth here to
     # match your UNO + dashboard. If you later move to a secured broker,
@@ -165,11 +1933,26 @@ def main():
     # client.tls_set(cert_reqs=ssl.CERT_REQUIRED)   # and change PORT to 8883
 
     client.on_connect = on_connect
+    client.on_disconnect = on_disconnect
     client.on_message = on_message
 
+    # A service stop (SIGTERM) takes the same path as Ctrl+C. Readings already
+    # acked to the broker exist only in the write queue, so they must be
+    # flushed before exiting; a message interrupted before its ack is
+    # redelivered with the session.
+    signal.signal(signal.SIGTERM, signal.default_int_handler)
+
     client.connect(BROKER, PORT)
     print("[System] MQTT connected. Listening for messages...")
-    client.loop_forever()
+    try:
+        client.loop_forever()
+    except KeyboardInterrupt:
+        print("[System] Stopping, flushing queued writes...")
+    finally:
+        client.disconnect()
+        if upload_server is not None:
+            upload_server.shutdown()
+        stop_firebase_writer(writer)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,101 @@
+"""
+Host-side stand-in for the UNO R4 sketch.
+
+Publishes the same telemetry JSON as mqttPublishTelemetry() in
+Sketch/MqttTelemetry.cpp, on the same topic layout, with the same alert
+thresholds as Sketch.ino. Use it against the local broker to drive the
+ingester and dashboard without hardware, or with --devices N to simulate a
+fleet (one room per device).
+
+Usage:
+    python local-env/device_sim.py [--host localhost] [--devices 1] [--interval 3]
+"""
+
+import argparse
+import json
+import math
+import random
+import time
+
+import paho.mqtt.client as mqtt  # pip install paho-mqtt
+
+# Same thresholds as Sketch.ino (section 3)
+MIN_TEMP = 18.0
+MAX_TEMP = 26.0
+MAX_HUMIDITY = 60.0
+
+SITE = "circuit5"
+
+# Same QoS as mqttPublishTelemetry(): the ingester's persistent session only
+# gets QoS 1 messages queued while it is offline
+TELEMETRY_QOS = 1
+
+
+def room_name(index: int) -> str:
+    return "living-room" if index == 0 else f"room-{index}"
+
+
+def topic_for(room: str) -> str:
+    return f"hope/iot/{SITE}/{room}/uno-r4/telemetry"
+
+
+def device_id_for(room: str) -> str:
+    return f"uno-r4-{room}"
+
+
+def simulated_reading(index: int, t: float):
+    """Smooth daily cycle plus noise, offset per room so devices differ."""
+    phase = (t / 86400.0) * 2 * math.pi + index
+    temperature = 22.0 + 4.0 * math.sin(phase) + random.uniform(-0.3, 0.3)
+    humidity = 50.0 + 10.0 * math.cos(phase) + random.uniform(-1.0, 1.0)
+    return round(temperature, 2), round(humidity, 2)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--devices", type=int, default=1)
+    parser.add_argument("--interval", type=float, default=3.0, help="seconds between readings (sketch: 3)")
+    parser.add_argument("--fault-rate", type=float, default=0.0, help="fraction of failed DHT reads")
+    parser.add_argument("--count", type=int, default=0, help="stop after this many rounds (0 = forever)")
+    args = parser.parse_args()
+
+    client = mqtt.Client(client_id=f"device-sim-{random.randrange(1 << 24):06x}")
+    client.connect(args.host, args.port)
+    client.loop_start()
+    print(f"[Sim] {args.devices} device(s) publishing every {args.interval}s to {args.host}:{args.port}")
+
+    rooms = [room_name(i) for i in range(args.devices)]
+    rounds = 0
+    next_tick = time.monotonic()
+    try:
+        while args.count == 0 or rounds < args.count:
+            now = time.time()
+            for i, room in enumerate(rooms):
+                if random.random() < args.fault_rate:
+                    # Sketch skips the publish when the DHT read fails
+                    continue
+                temperature, humidity = simulated_reading(i, now)
+                alert = temperature < MIN_TEMP or temperature > MAX_TEMP or humidity > MAX_HUMIDITY
+                payload = json.dumps({
+                    "deviceId": device_id_for(room),
+                    "temperature": temperature,
+                    "humidity": humidity,
+                    "status": "alert" if alert else "normal",
+                    "fw": "sim",
+                    "ts": int(now * 1000),
+                }, separators=(",", ":"))
+                client.publish(topic_for(room), payload, qos=TELEMETRY_QOS)
+            rounds += 1
+            next_tick += args.interval
+            time.sleep(max(0.0, next_tick - time.monotonic()))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        client.loop_stop()
+        client.disconnect()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,220 @@
+"""
+Local stand-in for an MQTT-SN gateway (UDP -> Mosquitto).
+
+Speaks the subset of MQTT-SN v1.2 that Sketch/MqttSnClient.cpp uses and
+forwards to the local broker over ordinary MQTT, so the ingester and
+dashboard see the same topics whichever transport the board is on:
+
+    CONNECT / CONNACK            - one broker connection per client ID
+    PUBLISH QoS -1 / 0 / 1       - pre-defined topic IDs only (table below)
+    PUBACK                       - sent once the broker has the QoS 1 message
+    PINGREQ / PINGRESP
+    DISCONNECT (with duration)   - sleeping client: the session is kept
+
+Counts what crosses the UDP side so tools/transport_compare.py can compare
+it with the TCP path. --delay-ms adds one-way latency to every reply.
+
+Usage:
+    python local-env/mqttsn_gateway.py [--port 10000] [--broker localhost]
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+import paho.mqtt.client as mqtt  # pip install paho-mqtt
+
+SITE = "circuit5"
+
+# Pre-defined topic IDs, the same as MQTTSN_TOPIC_* in Sketch/MqttTelemetry.cpp
+TOPIC_NAMES = {
+    1: "telemetry",
+    2: "alert",
+    3: "diagnostics",
+}
+
+CONNECT, CONNACK = 0x04, 0x05
+PUBLISH, PUBACK = 0x0C, 0x0D
+PINGREQ, PINGRESP = 0x16, 0x17
+DISCONNECT = 0x18
+
+FLAG_CLEAN_SESSION = 0x04
+FLAG_TOPIC_TYPE = 0x03
+TOPIC_PREDEFINED = 0x01
+
+RC_ACCEPTED = 0x00
+RC_INVALID_TOPIC = 0x02
+RC_NOT_SUPPORTED = 0x03
+
+
+def topic_for(room, topic_id):
+    name = TOPIC_NAMES.get(topic_id)
+    return f"hope/iot/{SITE}/{room}/uno-r4/{name}" if name else None
+
+
+def parse_packet(data):
+    """Returns (type, body) or None. Handles both length encodings."""
+    if len(data) >= 4 and data[0] == 0x01:
+        length, offset = struct.unpack(">H", data[1:3])[0], 3
+    elif len(data) >= 2:
+        length, offset = data[0], 1
+    else:
+        return None
+    if length != len(data):
+        return None
+    return data[offset], data[offset + 1:]
+
+
+def encode_packet(msg_type, body=b""):
+    length = 2 + len(body)
+    if length > 255:
+        return b"\x01" + struct.pack(">H", length + 2) + bytes([msg_type]) + body
+    return bytes([length, msg_type]) + body
+
+
+class Session:
+    """One MQTT-SN client and its broker connection."""
+
+    def __init__(self, client_id, broker, port):
+        self.client_id = client_id
+        self.state = "active"
+        self.sleep_until = 0.0
+        self.mqtt = mqtt.Client(client_id=f"mqttsn-{client_id}", clean_session=True)
+        self.mqtt.connect(broker, port)
+        self.mqtt.loop_start()
+
+    def close(self):
+        self.mqtt.loop_stop()
+        self.mqtt.disconnect()
+
+
+class Gateway:
+    def __init__(self, args):
+        self.args = args
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind(("0.0.0.0", args.port))
+        self.sessions = {}      # (host, port) -> Session
+        self.anonymous = None   # broker connection for QoS -1 from unknown clients
+        self.stats = {"packets_in": 0, "bytes_in": 0, "packets_out": 0, "bytes_out": 0, "published": 0}
+
+    def send(self, addr, msg_type, body=b""):
+        if self.args.delay_ms:
+            time.sleep(self.args.delay_ms / 1000.0)
+        packet = encode_packet(msg_type, body)
+        self.sock.sendto(packet, addr)
+        self.stats["packets_out"] += 1
+        self.stats["bytes_out"] += len(packet)
+
+    def forward(self, client, topic_id, payload, qos):
+        topic = topic_for(self.args.room, topic_id)
+        if topic is None:
+            return RC_INVALID_TOPIC
+        # Always QoS 1 towards the broker, whatever the client used over the
+        # air: QoS 0 is not queued for the ingester's offline session
+        info = client.publish(topic, payload, qos=1)
+        if qos == 1:
+            info.wait_for_publish(timeout=5)
+            if not info.is_published():
+                return RC_NOT_SUPPORTED
+        self.stats["published"] += 1
+        return RC_ACCEPTED
+
+    def handle(self, addr, msg_type, body):
+        session = self.sessions.get(addr)
+
+        if msg_type == CONNECT and len(body) >= 4:
+            flags, client_id = body[0], body[4:].decode("utf-8", "replace")
+            if session and (flags & FLAG_CLEAN_SESSION or session.client_id != client_id):
+                session.close()
+                session = None
+            if session is None:
+                session = self.sessions[addr] = Session(client_id, self.args.broker, self.args.broker_port)
+                print(f"[Gateway] {client_id} connected from {addr[0]}:{addr[1]}")
+            session.state = "active"
+            self.send(addr, CONNACK, bytes([RC_ACCEPTED]))
+
+        elif msg_type == PUBLISH and len(body) >= 5:
+            flags = body[0]
+            topic_id, msg_id = struct.unpack(">HH", body[1:5])
+            qos = (flags >> 5) & 0x03
+            payload = body[5:]
+            if flags & FLAG_TOPIC_TYPE != TOPIC_PREDEFINED:
+                rc = RC_NOT_SUPPORTED
+            elif qos == 3:
+                # QoS -1: no connection needed
+                if session is None and self.anonymous is None:
+                    self.anonymous = mqtt.Client(client_id="mqttsn-gateway")
+                    self.anonymous.connect(self.args.broker, self.args.broker_port)
+                    self.anonymous.loop_start()
+                self.forward(session.mqtt if session else self.anonymous, topic_id, payload, 0)
+                return
+            elif session is None or session.state != "active":
+                rc = RC_NOT_SUPPORTED
+            else:
+                rc = self.forward(session.mqtt, topic_id, payload, qos)
+            if qos == 1 or rc != RC_ACCEPTED:
+                self.send(addr, PUBACK, struct.pack(">HHB", topic_id, msg_id, rc))
+
+        elif msg_type == PINGREQ:
+            self.send(addr, PINGRESP)
+
+        elif msg_type == DISCONNECT:
+            if session and len(body) >= 2:
+                duration = struct.unpack(">H", body[:2])[0]
+                session.state = "asleep"
+                session.sleep_until = time.time() + duration
+            elif session:
+                session.close()
+                del self.sessions[addr]
+            self.send(addr, DISCONNECT)
+
+    def expire_sleepers(self):
+        now = time.time()
+        for addr, session in list(self.sessions.items()):
+            if session.state == "asleep" and now > session.sleep_until:
+                print(f"[Gateway] {session.client_id} slept past its duration, dropping session")
+                session.close()
+                del self.sessions[addr]
+
+    def run(self):
+        print(f"[Gateway] MQTT-SN on udp/{self.args.port} -> {self.args.broker}:{self.args.broker_port}")
+        self.sock.settimeout(1.0)
+        last_report = time.time()
+        while True:
+            try:
+                data, addr = self.sock.recvfrom(1024)
+            except socket.timeout:
+                data = None
+            if data:
+                self.stats["packets_in"] += 1
+                self.stats["bytes_in"] += len(data)
+                parsed = parse_packet(data)
+                if parsed:
+                    self.handle(addr, *parsed)
+
+            self.expire_sleepers()
+            if self.args.report and time.time() - last_report >= self.args.report:
+                last_report = time.time()
+                print(f"[Gateway] {self.stats}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=10000, help="UDP port (sketch: MQTTSN_GATEWAY_PORT)")
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--broker-port", type=int, default=1883)
+    parser.add_argument("--room", default="living-room", help="room the pre-defined topics belong to")
+    parser.add_argument("--delay-ms", type=float, default=0, help="added latency per reply")
+    parser.add_argument("--report", type=float, default=60, help="seconds between stats lines (0 = off)")
+    args = parser.parse_args()
+
+    gateway = Gateway(args)
+    try:
+        gateway.run()
+    except KeyboardInterrupt:
+        print(f"[Gateway] {gateway.stats}")
+
+
+if __name__ == "__main__":
+    main()
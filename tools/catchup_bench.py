@@ -0,0 +1,233 @@
+"""
+Catch-up throughput benchmark: MQTT session replay vs HTTP batch upload.
+
+--transport mqtt (default) simulates an ingester outage against a local
+broker:
+  1. registers the ingester's persistent session (fixed client ID, QoS 1),
+  2. goes offline while a publisher sends <outage> seconds worth of readings
+     the way the board does (QoS 1, device timestamps <interval> apart),
+  3. restarts the ingester and times how long the broker backlog takes to
+     drain through the batched Firebase write path, and checks the stored
+     readings kept their device timestamps.
+
+--transport http simulates a broker outage instead: the device buffers
+<outage> seconds worth of readings and uploads them to the ingester's batch
+endpoint (section 8 of firebase_ingester.py) the way Sketch/BatchUpload.cpp
+does, --batch-size readings per chunked POST, one POST at a time. No broker
+is needed. Both report drain time, throughput and bytes sent.
+
+By default Firebase writes go to an in-process sink that sleeps for
+--write-latency-ms per batch (roughly one RTDB round trip), so the number
+measures the ingester itself. Pass --firebase to write to the configured
+database instead (use the local emulator, not production).
+
+Usage (from the repo root, broker on localhost:1883):
+    python tools/catchup_bench.py --outage 600 --interval 3
+    python tools/catchup_bench.py --outage 600 --interval 3 --transport http [--gzip]
+"""
+
+import argparse
+import gzip
+import http.client
+import json
+import os
+import sys
+import time
+from datetime import datetime
+
+import paho.mqtt.client as mqtt  # pip install paho-mqtt
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+import firebase_ingester as ing  # noqa: E402
+
+DEVICE_ID = "uno-r4-living-room"
+DEVICE_QOS = 1                  # mqttPublishTelemetry() (MQTT_TELEMETRY_QOS)
+
+
+def register_session(host, port):
+    """Connect once as the ingester so the broker creates the session."""
+    c = mqtt.Client(client_id=ing.INGESTER_CLIENT_ID, clean_session=False)
+    c.connect(host, port)
+    c.loop_start()
+    result, mid = c.subscribe(ing.SUBSCRIPTIONS)
+    time.sleep(0.5)
+    c.loop_stop()
+    c.disconnect()
+
+
+def publish_backlog(host, port, count, first_ms, interval_s):
+    """
+    Publish count readings as the board would have during the outage, sampled
+    interval_s apart from first_ms. Returns the MQTT bytes published (PUBLISH
+    packets, excl. TCP/IP).
+    """
+    pub = mqtt.Client(client_id="catchup-bench-publisher")
+    pub.max_inflight_messages_set(100)
+    pub.connect(host, port)
+    pub.loop_start()
+    sent = 0
+    for i in range(count):
+        payload = json.dumps({
+            "deviceId": DEVICE_ID,
+            "temperature": 21.0 + (i % 50) / 10,
+            "humidity": 45.0 + (i % 30) / 10,
+            "status": "normal",
+            "fw": "1.4.0",
+            "ts": first_ms + int(i * interval_s * 1000),
+        }, separators=(",", ":"))
+        pub.publish(ing.TOPIC, payload, qos=DEVICE_QOS).wait_for_publish()
+        sent += 2 + 2 + len(ing.TOPIC) + (2 if DEVICE_QOS else 0) + len(payload)
+    pub.loop_stop()
+    pub.disconnect()
+    return sent
+
+
+def upload_backlog(args, count):
+    """
+    Upload count buffered readings like Sketch/BatchUpload.cpp. Returns
+    (seconds until the last ack, HTTP body bytes sent).
+    """
+    boot = f"{int(time.time()) & 0xFFFFFFFF:08x}"
+    sent, seq = 0, 1
+    start = time.monotonic()
+    while seq <= count:
+        last = min(count, seq + args.batch_size - 1)
+        body = "".join(
+            f"{n},{int((count - n) * args.interval * 1000)},"
+            f"{21.0 + (n % 50) / 10:.2f},{45.0 + (n % 30) / 10:.2f},n\n"
+            for n in range(seq, last + 1)).encode()
+        headers = {"Authorization": f"Bearer {ing.BATCH_UPLOAD_TOKEN}",
+                   "X-Device-Id": DEVICE_ID, "X-Boot-Id": boot, "Content-Type": "text/csv"}
+        if args.gzip:
+            body = gzip.compress(body)
+            headers["Content-Encoding"] = "gzip"
+
+        conn = http.client.HTTPConnection("127.0.0.1", ing.BATCH_UPLOAD_PORT)
+        # Chunked like the board: one chunk per 20 lines' worth of bytes
+        chunks = [body[i:i + 520] for i in range(0, len(body), 520)]
+        conn.request("POST", "/ingest/circuit5/living-room/uno-r4", body=iter(chunks),
+                     headers=headers, encode_chunked=True)
+        ack = json.loads(conn.getresponse().read())["ack"]
+        conn.close()
+        sent += len(body)
+        seq = ack + 1
+    return time.monotonic() - start, sent
+
+
+def run_http(args, count):
+    # The endpoint is off by default; the bench runs it on loopback
+    ing.BATCH_UPLOAD_PORT = ing.BATCH_UPLOAD_PORT or 8088
+    ing.BATCH_UPLOAD_TOKEN = ing.BATCH_UPLOAD_TOKEN or "catchup-bench"
+    writer = ing.start_firebase_writer()
+    server = ing.start_batch_upload_server()
+    print(f"[Bench] Broker down, device buffered {count} readings; uploading "
+          f"{args.batch_size} per POST{' (gzip)' if args.gzip else ''}")
+
+    start = time.monotonic()
+    acked_s, sent = upload_backlog(args, count)
+    deadline = start + max(60, args.outage)
+    while ing.write_stats["readings"] < count and time.monotonic() < deadline:
+        time.sleep(0.01)
+    elapsed = time.monotonic() - start
+
+    server.shutdown()
+    ing.stop_firebase_writer(writer)
+    return elapsed, sent, f"all acked after  : {acked_s:.2f} s"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--outage", type=float, default=600, help="simulated outage in seconds")
+    parser.add_argument("--interval", type=float, default=3, help="device publish interval in seconds")
+    parser.add_argument("--write-latency-ms", type=float, default=80, help="simulated latency per batch write")
+    parser.add_argument("--firebase", action="store_true", help="write to the configured database")
+    parser.add_argument("--transport", choices=("mqtt", "http"), default="mqtt")
+    parser.add_argument("--batch-size", type=int, default=120, help="readings per POST (http)")
+    parser.add_argument("--gzip", action="store_true", help="gzip the upload body (http)")
+    args = parser.parse_args()
+
+    count = int(args.outage / args.interval)
+
+    stored_times = []
+    if args.firebase:
+        ing.init_firebase()
+    else:
+        def sink(updates):
+            stored_times.extend(v["timestamp"] for p, v in updates.items() if p.startswith("readings/"))
+            time.sleep(args.write_latency_ms / 1000.0)
+        ing.flush_batch_to_firebase = sink
+        ing.SNAPSHOT_DIR = ""       # no database to export history from
+        ing._load_upload_ack = lambda device_id: {"boot": None, "seq": 0, "acked": 0}
+
+    if args.transport == "http":
+        elapsed, sent, extra = run_http(args, count)
+    else:
+        elapsed, sent, extra = run_mqtt(args, count, stored_times)
+    report(args, count, elapsed, sent, extra)
+
+
+def run_mqtt(args, count, stored_times):
+    print(f"[Bench] Registering persistent session on {args.host}:{args.port}")
+    register_session(args.host, args.port)
+
+    # The outage is simulated: readings are stamped as if taken over it
+    outage_start_ms = int((time.time() - args.outage) * 1000)
+    print(f"[Bench] Ingester offline, publishing {count} readings ({args.outage:.0f}s outage)")
+    sent = publish_backlog(args.host, args.port, count, outage_start_ms, args.interval)
+
+    print("[Bench] Restarting ingester...")
+    # As main() does: the device's /latest entry earns it the catch-up credit
+    if args.firebase:
+        latest = ing.load_latest_snapshots()
+    else:
+        latest = {DEVICE_ID: {"topic": ing.TOPIC, "lastSeenMs": outage_start_ms}}
+    ing.seed_known_sources(latest)
+    writer = ing.start_firebase_writer()
+    client = mqtt.Client(client_id=ing.INGESTER_CLIENT_ID, clean_session=False)
+    client.on_connect = ing.on_connect
+    client.on_disconnect = ing.on_disconnect
+    client.on_message = ing.on_message
+
+    start = time.monotonic()
+    client.connect(args.host, args.port)
+    client.loop_start()
+
+    # Wait for the whole backlog to reach the (real or simulated) database
+    deadline = start + max(60, args.outage)
+    while ing.write_stats["readings"] < count and time.monotonic() < deadline:
+        time.sleep(0.01)
+    elapsed = time.monotonic() - start
+
+    client.loop_stop()
+    client.disconnect()
+    ing.stop_firebase_writer(writer)
+
+    extra = None
+    if stored_times:
+        span = (datetime.fromisoformat(max(stored_times)) - datetime.fromisoformat(min(stored_times)))
+        extra = (f"stored time span : {span.total_seconds():.0f} s "
+                 f"(readings sampled over {(count - 1) * args.interval:.0f} s)")
+    return elapsed, sent, extra
+
+
+def report(args, count, elapsed, sent, extra):
+    written = ing.write_stats["readings"]
+    print()
+    print(f"=== Catch-up result ({args.transport}) ===")
+    print(f"backlog readings : {count}")
+    print(f"written          : {written}")
+    print(f"admission drops  : {ing.admission_stats['rate_limited'] + ing.admission_stats['oversize']}")
+    print(f"batches          : {ing.write_stats['batches']}")
+    print(f"drain time       : {elapsed:.2f} s")
+    print(f"throughput       : {written / elapsed:.0f} readings/s" if elapsed > 0 else "")
+    print(f"bytes sent       : {sent} ({sent / max(count, 1):.1f} per reading)")
+    if extra:
+        print(extra)
+    if written < count:
+        print("WARNING: backlog not fully drained before timeout")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,346 @@
+#!/usr/bin/env node
+// Headless performance benchmark for deploy-dashboard/index.html.
+//
+// Loads the real dashboard in headless Chrome with Firebase and Paho MQTT
+// replaced by in-page stubs (stubs/) serving synthetic readings, then for
+// each dataset size measures:
+//   - every range button (Hour/Day/Month/Year) as a user click:
+//     total switch time, fetch, aggregation, chart render, long tasks, heap
+//   - the aggregation path over the FULL dataset per range
+//     (filterRecordsByTimeWindow + updateHistoricalChartFromRecords)
+//   - the live chart path: cost per incoming MQTT message
+//
+// Usage:
+//   npm install
+//   node bench.js [--sizes 10000,100000,1000000] [--span-days 365]
+//                 [--latency-ms 0] [--out report.json] [--compare old.json]
+//                 [--offline] [--chartjs path/to/chart.umd.js]
+
+const fs = require("fs");
+const path = require("path");
+const { execSync } = require("child_process");
+const puppeteer = require("puppeteer");
+
+const RANGES = ["hour", "day", "month", "year"];
+const LIVE_MESSAGES = 300;
+const ROOT = path.resolve(__dirname, "..", "..");
+const DASHBOARD = path.join(ROOT, "deploy-dashboard", "index.html");
+
+function parseArgs(argv) {
+    const args = {
+        sizes: [10000, 100000, 1000000],
+        spanDays: 365,
+        latencyMs: 0,
+        out: "dashboard-bench-report.json",
+        compare: null,
+        offline: false,
+        chartjs: null,
+    };
+    for (let i = 2; i < argv.length; i++) {
+        const a = argv[i];
+        const next = () => argv[++i];
+        if (a === "--sizes") args.sizes = next().split(",").map(Number);
+        else if (a === "--span-days") args.spanDays = Number(next());
+        else if (a === "--latency-ms") args.latencyMs = Number(next());
+        else if (a === "--out") args.out = next();
+        else if (a === "--compare") args.compare = next();
+        else if (a === "--offline") args.offline = true;
+        else if (a === "--chartjs") args.chartjs = next();
+        else throw new Error(`Unknown argument: ${a}`);
+    }
+    return args;
+}
+
+function resolveChartJs(explicit) {
+    if (explicit) return explicit;
+    try {
+        return require.resolve("chart.js/dist/chart.umd.js");
+    } catch (e) {
+        return null;
+    }
+}
+
+const stub = (name) => fs.readFileSync(path.join(__dirname, "stubs", name), "utf8");
+
+async function installInterception(page, args) {
+    const firebaseStub = stub("firebase-stub.js");
+    const pahoStub = stub("paho-stub.js");
+    const lucideStub = stub("lucide-stub.js");
+    const chartJsPath = resolveChartJs(args.chartjs);
+    const js = (body) => ({ status: 200, contentType: "application/javascript", body });
+
+    await page.setRequestInterception(true);
+    page.on("request", (req) => {
+        const url = req.url();
+        if (url.includes("firebase-app-compat")) return req.respond(js(firebaseStub));
+        if (url.includes("firebase-database-compat")) return req.respond(js("/* stubbed */"));
+        if (url.includes("paho-mqtt")) return req.respond(js(pahoStub));
+        if (url.includes("lucide")) return req.respond(js(lucideStub));
+        if (url.includes("npm/chart.js") && chartJsPath) {
+            return req.respond(js(fs.readFileSync(chartJsPath, "utf8")));
+        }
+        if (args.offline && url.startsWith("http")) {
+            // Styling only (Tailwind, fonts); keep the run network-free
+            return req.respond(url.includes("fonts") ? { status: 200, contentType: "text/css", body: "" } : js(""));
+        }
+        return req.continue();
+    });
+}
+
+// Wrap the dashboard's global functions so every call is timed. Calls inside
+// index.html resolve these names through the global object, so the wrappers
+// see internal calls too. Missing functions are skipped.
+function instrument() {
+    const b = window.__bench = {
+        timings: {},
+        calls: {},
+        renderMs: 0,
+        pending: 0,
+        reset() { this.timings = {}; this.calls = {}; this.renderMs = 0; },
+        add(name, ms) {
+            this.timings[name] = (this.timings[name] || 0) + ms;
+            this.calls[name] = (this.calls[name] || 0) + 1;
+        },
+    };
+
+    const wrap = (name) => {
+        const orig = window[name];
+        if (typeof orig !== "function") return;
+        window[name] = function (...fnArgs) {
+            const t0 = performance.now();
+            const result = orig.apply(this, fnArgs);
+            if (result && typeof result.then === "function") {
+                b.pending++;
+                return result.finally(() => { b.pending--; b.add(name, performance.now() - t0); });
+            }
+            b.add(name, performance.now() - t0);
+            return result;
+        };
+    };
+
+    ["updateHistoricalChart", "fetchHistoryFromFirebase", "filterRecordsByTimeWindow",
+     "updateHistoricalChartFromRecords", "updateLiveDashboard"].forEach(wrap);
+
+    // Chart render time: historicalChart.update() including layout + draw
+    const origUpdate = historicalChart.update.bind(historicalChart);
+    historicalChart.update = (mode) => {
+        const t0 = performance.now();
+        const r = origUpdate(mode);
+        b.renderMs += performance.now() - t0;
+        return r;
+    };
+}
+
+function installLongTaskObserver() {
+    window.__longTasks = [];
+    try {
+        new PerformanceObserver((list) => {
+            for (const e of list.getEntries()) window.__longTasks.push({ start: e.startTime, duration: e.duration });
+        }).observe({ type: "longtask", buffered: true });
+    } catch (e) {
+        // longtask unsupported: report zero
+    }
+}
+
+async function heapMB(cdp) {
+    await cdp.send("HeapProfiler.collectGarbage");
+    const { metrics } = await cdp.send("Performance.getMetrics");
+    const used = metrics.find((m) => m.name === "JSHeapUsedSize");
+    return used ? used.value / (1024 * 1024) : null;
+}
+
+// Wait for idle-time history prefetch, the realtime listener's follow-up
+// callback and two frames
+async function settle(page, args) {
+    await page.waitForFunction(() => typeof historyPrefetchRunning === "undefined" || !historyPrefetchRunning,
+                               { timeout: 120000 });
+    await page.waitForFunction(() => window.__bench.pending === 0, { timeout: 120000 });
+    await new Promise((r) => setTimeout(r, args.latencyMs + 50));
+    await page.evaluate(() => new Promise((r) => requestAnimationFrame(() => requestAnimationFrame(r))));
+    await page.waitForFunction(() => window.__bench.pending === 0, { timeout: 120000 });
+}
+
+async function measureRangeClicks(page, cdp, args) {
+    const out = {};
+    for (const range of RANGES) {
+        await settle(page, args);
+        await page.evaluate(() => window.__bench.reset());
+        const t0 = await page.evaluate(() => performance.now());
+        await page.click(`.btn-chart[data-range="${range}"]`);
+        await settle(page, args);
+
+        const m = await page.evaluate((since) => {
+            const b = window.__bench;
+            const tasks = window.__longTasks.filter((t) => t.start >= since);
+            const fromRecords = b.timings.updateHistoricalChartFromRecords || 0;
+            return {
+                switchMs: b.timings.updateHistoricalChart || 0,
+                fetchMs: b.timings.fetchHistoryFromFirebase || 0,
+                filterMs: b.timings.filterRecordsByTimeWindow || 0,
+                aggregateMs: Math.max(0, fromRecords - b.renderMs),
+                renderMs: b.renderMs,
+                aggregations: b.calls.updateHistoricalChartFromRecords || 0,
+                longTasks: tasks.length,
+                longTaskMs: tasks.reduce((s, t) => s + t.duration, 0),
+                points: historicalChart.data.labels.length,
+            };
+        }, t0);
+        m.heapMB = await heapMB(cdp);
+        out[range] = m;
+    }
+    return out;
+}
+
+async function measureFullDataset(page, cdp) {
+    await page.evaluate(() => { window.__benchAll = window.__benchStub.allRecords(); });
+    const out = { heapWithDatasetMB: await heapMB(cdp) };
+    for (const range of RANGES) {
+        out[range] = await page.evaluate((r) => {
+            const all = window.__benchAll;
+            const prevRange = currentHistoryRange;
+            currentHistoryRange = r;
+
+            const t0 = performance.now();
+            const filtered = filterRecordsByTimeWindow(all, r);
+            const t1 = performance.now();
+
+            // Aggregation only: suppress the chart update during this pass
+            const update = historicalChart.update;
+            historicalChart.update = () => {};
+            updateHistoricalChartFromRecords(filtered);
+            historicalChart.update = update;
+            const t2 = performance.now();
+
+            historicalChart.update();
+            const t3 = performance.now();
+
+            currentHistoryRange = prevRange;
+            return { inWindow: filtered.length, filterMs: t1 - t0, aggregateMs: t2 - t1, renderMs: t3 - t2 };
+        }, range);
+    }
+    await page.evaluate(() => { delete window.__benchAll; });
+    return out;
+}
+
+async function measureLive(page) {
+    return page.evaluate(async (count) => {
+        const costs = [];
+        for (let i = 0; i < count; i++) {
+            const payload = JSON.stringify({
+                deviceId: "uno-r4-living-room",
+                temperature: 22 + Math.sin(i / 10) * 3,
+                humidity: 50 + Math.cos(i / 10) * 5,
+                status: "normal",
+            });
+            const t0 = performance.now();
+            window.__benchMqtt.emit(payload);
+            costs.push(performance.now() - t0);
+            if (i % 10 === 0) await new Promise((r) => requestAnimationFrame(r));
+        }
+        costs.sort((a, b) => a - b);
+        const mean = costs.reduce((s, c) => s + c, 0) / costs.length;
+        return { messages: count, meanMs: mean, p95Ms: costs[Math.floor(costs.length * 0.95)], maxMs: costs[costs.length - 1] };
+    }, LIVE_MESSAGES);
+}
+
+async function runDataset(browser, args, records) {
+    const page = await browser.newPage();
+    await page.setViewport({ width: 1440, height: 900 });
+    await installInterception(page, args);
+    await page.evaluateOnNewDocument((cfg) => { window.__BENCH_CONFIG = cfg; },
+        { records, spanDays: args.spanDays, latencyMs: args.latencyMs, seed: 42 });
+    await page.evaluateOnNewDocument(installLongTaskObserver);
+    const cdp = await page.target().createCDPSession();
+    await cdp.send("Performance.enable");
+
+    const tLoad = Date.now();
+    await page.goto("file://" + DASHBOARD, { waitUntil: "load", timeout: 300000 });
+    await page.evaluate(instrument);
+    await page.evaluate(() => showPage("page-history"));
+    const loadMs = Date.now() - tLoad;
+
+    const result = {
+        records,
+        loadMs,
+        heapAfterLoadMB: await heapMB(cdp),
+        ranges: await measureRangeClicks(page, cdp, args),
+        live: await measureLive(page),
+        full: await measureFullDataset(page, cdp),
+    };
+    await page.close();
+    return result;
+}
+
+const fmt = (v) => (v == null ? "-" : typeof v === "number" ? v.toFixed(1) : String(v));
+
+function printReport(report) {
+    for (const r of report.results) {
+        console.log(`\n## ${r.records.toLocaleString()} readings (load ${r.loadMs} ms, heap ${fmt(r.heapAfterLoadMB)} MB)`);
+        console.log("| range | switch ms | fetch ms | aggregate ms | render ms | aggregations | long tasks | long task ms | heap MB |");
+        console.log("|---|---|---|---|---|---|---|---|---|");
+        for (const range of RANGES) {
+            const m = r.ranges[range];
+            console.log(`| ${range} | ${fmt(m.switchMs)} | ${fmt(m.fetchMs)} | ${fmt(m.aggregateMs)} | ${fmt(m.renderMs)} | ${m.aggregations} | ${m.longTasks} | ${fmt(m.longTaskMs)} | ${fmt(m.heapMB)} |`);
+        }
+        console.log(`\nFull dataset (heap ${fmt(r.full.heapWithDatasetMB)} MB):`);
+        console.log("| range | in window | filter ms | aggregate ms | render ms |");
+        console.log("|---|---|---|---|---|");
+        for (const range of RANGES) {
+            const m = r.full[range];
+            console.log(`| ${range} | ${m.inWindow} | ${fmt(m.filterMs)} | ${fmt(m.aggregateMs)} | ${fmt(m.renderMs)} |`);
+        }
+        console.log(`\nLive chart: ${r.live.messages} msgs, mean ${fmt(r.live.meanMs)} ms, p95 ${fmt(r.live.p95Ms)} ms, max ${fmt(r.live.maxMs)} ms`);
+    }
+}
+
+function printComparison(report, previous) {
+    console.log(`\n## Comparison against ${previous.meta.commit} (${previous.meta.date})`);
+    console.log("| readings | range | switch ms (old → new) | full aggregate ms (old → new) |");
+    console.log("|---|---|---|---|");
+    for (const r of report.results) {
+        const old = previous.results.find((p) => p.records === r.records);
+        if (!old) continue;
+        for (const range of RANGES) {
+            console.log(`| ${r.records} | ${range} | ${fmt(old.ranges[range].switchMs)} → ${fmt(r.ranges[range].switchMs)}` +
+                ` | ${fmt(old.full[range].aggregateMs)} → ${fmt(r.full[range].aggregateMs)} |`);
+        }
+        console.log(`| ${r.records} | live p95 | ${fmt(old.live.p95Ms)} → ${fmt(r.live.p95Ms)} | |`);
+    }
+}
+
+async function main() {
+    const args = parseArgs(process.argv);
+    let commit = "unknown";
+    try {
+        commit = execSync("git rev-parse --short HEAD", { cwd: ROOT }).toString().trim();
+    } catch (e) { /* not a git checkout */ }
+
+    const browser = await puppeteer.launch({
+        headless: true,
+        args: ["--no-sandbox", "--enable-precise-memory-info", "--allow-file-access-from-files"],
+    });
+
+    const report = {
+        meta: { date: new Date().toISOString(), commit, chrome: await browser.version(), spanDays: args.spanDays, latencyMs: args.latencyMs },
+        results: [],
+    };
+
+    try {
+        for (const size of args.sizes) {
+            console.log(`[bench] ${size.toLocaleString()} readings...`);
+            report.results.push(await runDataset(browser, args, size));
+        }
+    } finally {
+        await browser.close();
+    }
+
+    fs.writeFileSync(args.out, JSON.stringify(report, null, 2));
+    printReport(report);
+    if (args.compare) printComparison(report, JSON.parse(fs.readFileSync(args.compare, "utf8")));
+    console.log(`\n[bench] Report written to ${args.out}`);
+}
+
+main().catch((err) => {
+    console.error(err);
+    process.exit(1);
+});
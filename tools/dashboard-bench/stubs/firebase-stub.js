@@ -0,0 +1,140 @@
+// Stand-in for firebase-app-compat.js + firebase-database-compat.js.
+// Serves a synthetic /readings/uno-r4-living-room series generated in-page
+// from window.__BENCH_CONFIG ({ records, spanDays, seed }).
+// Only the query surface index.html uses is implemented.
+(function () {
+    const cfg = window.__BENCH_CONFIG || {};
+    const DEVICE_PATH = "readings/uno-r4-living-room";
+    const PUSH_CHARS = "-0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
+
+    // Deterministic PRNG so runs are comparable
+    let seed = cfg.seed || 1;
+    const rand = () => {
+        seed = (seed * 1664525 + 1013904223) >>> 0;
+        return seed / 4294967296;
+    };
+
+    function pushKey(ms, i) {
+        let ts = "";
+        for (let k = 0; k < 8; k++) { ts = PUSH_CHARS.charAt(ms % 64) + ts; ms = Math.floor(ms / 64); }
+        let suffix = "";
+        for (let k = 0; k < 12; k++) { suffix = PUSH_CHARS.charAt(i % 64) + suffix; i = Math.floor(i / 64); }
+        return ts + suffix;
+    }
+
+    // Columnar storage keeps the baseline heap small; objects are only
+    // materialised for the slice a query returns.
+    const n = cfg.records || 0;
+    const spanMs = (cfg.spanDays || 365) * 24 * 3600 * 1000;
+    const end = Date.now();
+    const stepMs = n > 0 ? spanMs / n : 0;
+    const ts = new Float64Array(n);
+    const temp = new Float64Array(n);
+    const hum = new Float64Array(n);
+    const keys = new Array(n);
+    for (let i = 0; i < n; i++) {
+        const t = end - spanMs + i * stepMs;
+        ts[i] = t;
+        const daily = Math.sin((t / 86400000) * 2 * Math.PI);
+        temp[i] = Math.round((22 + 3 * daily + (rand() - 0.5)) * 100) / 100;
+        hum[i] = Math.round((50 + 8 * daily + (rand() - 0.5) * 4) * 100) / 100;
+        keys[i] = pushKey(Math.floor(t), i);
+    }
+
+    function materialise(i) {
+        return {
+            timestamp: new Date(ts[i]).toISOString(),
+            temperature: temp[i],
+            humidity: hum[i],
+            status: (temp[i] > 26 || hum[i] > 60) ? "alert" : "normal",
+        };
+    }
+
+    // Used by bench.js for the "full dataset" aggregation pass
+    window.__benchStub = {
+        count: n,
+        allRecords() {
+            const out = new Array(n);
+            for (let i = 0; i < n; i++) out[i] = Object.assign({ key: keys[i] }, materialise(i));
+            return out;
+        },
+        queries: 0,
+        listeners: 0,
+    };
+
+    function lowerBound(key) {
+        let lo = 0, hi = n;
+        while (lo < hi) { const mid = (lo + hi) >> 1; if (keys[mid] < key) lo = mid + 1; else hi = mid; }
+        return lo;
+    }
+
+    function upperBound(key) {
+        let lo = 0, hi = n;
+        while (lo < hi) { const mid = (lo + hi) >> 1; if (keys[mid] <= key) lo = mid + 1; else hi = mid; }
+        return lo;
+    }
+
+    class Snapshot {
+        constructor(path, from, to) { this.path = path; this.from = from; this.to = to; this.key = path.split("/").pop(); }
+        exists() { return this.to > this.from; }
+        val() {
+            if (this.path !== DEVICE_PATH || this.to <= this.from) return null;
+            const out = {};
+            for (let i = this.from; i < this.to; i++) out[keys[i]] = materialise(i);
+            return out;
+        }
+        forEach(cb) {
+            if (this.path !== DEVICE_PATH) return false;
+            for (let i = this.from; i < this.to; i++) {
+                const v = materialise(i);
+                if (cb({ key: keys[i], val: () => v }) === true) return true;
+            }
+            return false;
+        }
+    }
+
+    class Query {
+        constructor(path, opts) { this.path = path.replace(/^\/+|\/+$/g, ""); this.opts = opts || {}; this._cbs = []; }
+        _with(extra) { return new Query(this.path, Object.assign({}, this.opts, extra)); }
+        child(p) { return new Query(this.path + "/" + p); }
+        orderByKey() { return this._with({}); }
+        orderByChild() { return this._with({}); }
+        startAt(k) { return this._with({ startAt: k }); }
+        endAt(k) { return this._with({ endAt: k }); }
+        limitToLast(l) { return this._with({ limitToLast: l }); }
+        limitToFirst(l) { return this._with({ limitToFirst: l }); }
+        _range() {
+            if (this.path !== DEVICE_PATH) return [0, 0];
+            let from = this.opts.startAt != null ? lowerBound(this.opts.startAt) : 0;
+            let to = this.opts.endAt != null ? lowerBound(this.opts.endAt + "") : n;
+            if (this.opts.limitToLast != null) from = Math.max(from, to - this.opts.limitToLast);
+            if (this.opts.limitToFirst != null) to = Math.min(to, from + this.opts.limitToFirst);
+            return [from, Math.max(from, to)];
+        }
+        once() {
+            window.__benchStub.queries++;
+            const [from, to] = this._range();
+            return new Promise(resolve => setTimeout(() => resolve(new Snapshot(this.path, from, to)), cfg.latencyMs || 0));
+        }
+        on(event, cb) {
+            window.__benchStub.listeners++;
+            this._cbs.push(cb);
+            this.once().then(snap => { if (this._cbs.includes(cb)) cb(snap); });
+            return cb;
+        }
+        off() {
+            window.__benchStub.listeners -= this._cbs.length;
+            this._cbs = [];
+        }
+        get ref() { return this; }
+        set() { return Promise.resolve(); }
+        update() { return Promise.resolve(); }
+    }
+
+    window.firebase = {
+        initializeApp() { return {}; },
+        database() {
+            return { ref: (p) => new Query(p || ""), useEmulator() {} };
+        },
+    };
+})();
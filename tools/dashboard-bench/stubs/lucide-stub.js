@@ -0,0 +1,2 @@
+// Icons are irrelevant to the benchmark; avoid the network fetch.
+window.lucide = { createIcons() {} };
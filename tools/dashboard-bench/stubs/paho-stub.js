@@ -0,0 +1,41 @@
+// Stand-in for Paho MQTT (mqttws31.min.js). Connects immediately and lets
+// the benchmark inject telemetry with window.__benchMqtt.emit(payload).
+(function () {
+    const clients = [];
+
+    class Client {
+        constructor(host, port, path, clientId) {
+            this.clientId = clientId;
+            this.onMessageArrived = null;
+            this.onConnectionLost = null;
+            this.connected = false;
+        }
+        connect(opts) {
+            this.connected = true;
+            clients.push(this);
+            setTimeout(() => opts && opts.onSuccess && opts.onSuccess(), 0);
+        }
+        subscribe() {}
+        unsubscribe() {}
+        send() {}
+        disconnect() {
+            this.connected = false;
+            const i = clients.indexOf(this);
+            if (i >= 0) clients.splice(i, 1);
+        }
+        isConnected() { return this.connected; }
+    }
+
+    class Message {
+        constructor(payloadString) { this.payloadString = payloadString; }
+    }
+
+    window.Paho = { MQTT: { Client, Message } };
+    window.__benchMqtt = {
+        emit(payloadString, topic) {
+            const msg = { payloadString, destinationName: topic || "" };
+            for (const c of clients) if (c.onMessageArrived) c.onMessageArrived(msg);
+        },
+        clientCount() { return clients.length; },
+    };
+})();
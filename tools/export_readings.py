@@ -0,0 +1,45 @@
+"""
+Export a device's raw readings as CSV.
+
+Reads through the ingester's read_readings(), so per-sample nodes
+(/readings) and packed hourly blocks (/readingBlocks) come out the same way
+and in timestamp order, whichever layout the ingester was running with.
+
+Usage (from the repo root; CIRCUIT5_ENV=local for the emulator):
+    python tools/export_readings.py uno-r4-living-room --from 2026-10-01 --to 2026-10-08 > week.csv
+"""
+
+import argparse
+import csv
+import os
+import sys
+from datetime import datetime, timezone
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+import firebase_ingester as ing  # noqa: E402
+
+
+def parse_day(value):
+    return int(datetime.strptime(value, "%Y-%m-%d").replace(tzinfo=timezone.utc).timestamp() * 1000)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("device", help="device ID, e.g. uno-r4-living-room")
+    parser.add_argument("--from", dest="start", type=parse_day, help="first UTC day (YYYY-MM-DD)")
+    parser.add_argument("--to", dest="end", type=parse_day, help="UTC day to stop before (YYYY-MM-DD)")
+    args = parser.parse_args()
+
+    ing.init_firebase()
+    readings = ing.read_readings(args.device, args.start, args.end)
+    rows = sorted(readings.values(), key=lambda r: datetime.fromisoformat(r["timestamp"]))
+
+    writer = csv.writer(sys.stdout)
+    writer.writerow(["timestamp", "temperature", "humidity", "status"])
+    for r in rows:
+        writer.writerow([r["timestamp"], r["temperature"], r["humidity"], r["status"]])
+    print(f"[Export] {len(rows)} readings", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,279 @@
+"""
+Per-reading cost of the board's transports: MQTT over TCP vs MQTT-SN over UDP.
+
+Replays the sketch's telemetry through each path against the local stand-ins
+and reports, per reading, the protocol bytes and packets both ways, an
+estimate of what that is on the wire (with TCP/UDP/IP headers), how long the
+radio has to stay awake for the exchange, and how many readings reached the
+broker:
+
+    tcp          persistent MQTT connection, QoS 1 (what the sketch does by
+                 default; the connection, and so the radio, stays up between
+                 readings)
+    tcp-cycle    connect, publish, disconnect per reading (the TCP option
+                 for a board that sleeps between readings)
+    sn           MQTT-SN QoS -1 through the gateway: one datagram, no session
+                 needs to be awake
+    sn-qos1      MQTT-SN wake, QoS 1 publish, sleep (the sketch's alert path)
+
+The clients here send byte-for-byte what ArduinoMqttClient and
+Sketch/MqttSnClient.cpp send; the counts are at the MQTT / MQTT-SN layer.
+Session setup that happens once per boot is left out of the per-reading
+figures (tcp-cycle pays it every reading, so it stays in there).
+
+Usage (Mosquitto on localhost:1883, local-env/mqttsn_gateway.py running):
+    python tools/transport_compare.py --readings 200
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+import paho.mqtt.client as mqtt  # pip install paho-mqtt
+
+CLIENT_ID = "uno-r4-living-room"
+TOPIC = "hope/iot/circuit5/living-room/uno-r4/telemetry"
+TOPIC_ID = 1    # MQTTSN_TOPIC_TELEMETRY
+KEEPALIVE_S = 60
+SLEEP_S = 3600
+
+# Header overhead per packet on the wire (IPv4, no options)
+TCP_IP_HEADER = 40
+UDP_IP_HEADER = 28
+TCP_HANDSHAKE_SEGMENTS = 3      # SYN, SYN-ACK, ACK
+TCP_TEARDOWN_SEGMENTS = 4       # FIN, ACK each way
+
+
+def telemetry_payload(i):
+    # Byte-for-byte what mqttPublishTelemetry() builds (String(x, 2) formatting)
+    temperature = 21.0 + (i % 50) / 10
+    humidity = 45.0 + (i % 30) / 10
+    return (f'{{"deviceId":"{CLIENT_ID}","temperature":{temperature:.2f},"humidity":{humidity:.2f},'
+            f'"status":"normal","fw":"1.4.0","ts":{int(time.time() * 1000)}}}').encode()
+
+
+class Counter:
+    def __init__(self):
+        self.bytes_out = self.bytes_in = 0
+        self.packets_out = self.packets_in = 0
+        self.segments = 0       # TCP-only: handshake, teardown and ACK estimate
+        self.awake_s = 0.0
+
+    def snapshot(self):
+        return (self.bytes_out, self.bytes_in, self.packets_out, self.packets_in, self.segments)
+
+    def exclude(self, before, after):
+        """Drop a one-off exchange (session setup/teardown) from the per-reading totals."""
+        self.bytes_out -= after[0] - before[0]
+        self.bytes_in -= after[1] - before[1]
+        self.packets_out -= after[2] - before[2]
+        self.packets_in -= after[3] - before[3]
+        self.segments -= after[4] - before[4]
+
+
+# --- MQTT 3.1.1 over TCP ----------------------------------------------
+
+def remaining_length(n):
+    out = bytearray()
+    while True:
+        byte, n = n % 128, n // 128
+        out.append(byte | (0x80 if n else 0))
+        if not n:
+            return bytes(out)
+
+
+def mqtt_packet(header, body):
+    return bytes([header]) + remaining_length(len(body)) + body
+
+
+def mqtt_string(s):
+    return struct.pack(">H", len(s)) + s.encode()
+
+
+class TcpClient:
+    def __init__(self, host, port, counter):
+        self.host, self.port, self.c = host, port, counter
+        self.sock = None
+        self.msg_id = 0
+
+    def send(self, packet):
+        self.sock.sendall(packet)
+        self.c.bytes_out += len(packet)
+        self.c.packets_out += 1
+        self.c.segments += 2    # data segment + its ACK
+
+    def recv_packet(self):
+        head = self.sock.recv(2)
+        body = self.sock.recv(head[1]) if head[1] else b""
+        self.c.bytes_in += len(head) + len(body)
+        self.c.packets_in += 1
+        self.c.segments += 2
+        return head[0] >> 4
+
+    def connect(self):
+        self.sock = socket.create_connection((self.host, self.port))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.c.segments += TCP_HANDSHAKE_SEGMENTS
+        body = mqtt_string("MQTT") + bytes([4, 0x02]) + struct.pack(">H", KEEPALIVE_S) + mqtt_string(CLIENT_ID)
+        self.send(mqtt_packet(0x10, body))
+        if self.recv_packet() != 2:
+            raise RuntimeError("no CONNACK")
+
+    def publish(self, payload):
+        # QoS 1 like the sketch: packet ID, and the broker answers with PUBACK
+        self.msg_id = self.msg_id % 0xFFFF + 1
+        self.send(mqtt_packet(0x32, mqtt_string(TOPIC) + struct.pack(">H", self.msg_id) + payload))
+        if self.recv_packet() != 4:
+            raise RuntimeError("no PUBACK")
+
+    def disconnect(self):
+        self.send(mqtt_packet(0xE0, b""))
+        self.sock.close()
+        self.c.segments += TCP_TEARDOWN_SEGMENTS
+
+
+def run_tcp(args, counter, cycle):
+    client = TcpClient(args.host, args.port, counter)
+    if not cycle:
+        before = counter.snapshot()
+        client.connect()
+        counter.exclude(before, counter.snapshot())
+    for i in range(args.readings):
+        started = time.perf_counter()
+        if cycle:
+            client.connect()
+        client.publish(telemetry_payload(i))
+        if cycle:
+            client.disconnect()
+        counter.awake_s += time.perf_counter() - started
+        time.sleep(args.interval)
+    if not cycle:
+        before = counter.snapshot()
+        client.disconnect()
+        counter.exclude(before, counter.snapshot())
+
+
+# --- MQTT-SN over UDP -------------------------------------------------
+
+class SnClient:
+    def __init__(self, host, port, counter):
+        self.addr, self.c = (host, port), counter
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.settimeout(1.0)
+        self.msg_id = 0
+
+    def send(self, packet):
+        self.sock.sendto(packet, self.addr)
+        self.c.bytes_out += len(packet)
+        self.c.packets_out += 1
+
+    def await_type(self, msg_type):
+        while True:
+            data, _ = self.sock.recvfrom(512)
+            self.c.bytes_in += len(data)
+            self.c.packets_in += 1
+            if data[1] == msg_type:
+                return data
+
+    def connect(self, clean):
+        self.send(bytes([6 + len(CLIENT_ID), 0x04, 0x04 if clean else 0, 0x01])
+                  + struct.pack(">H", KEEPALIVE_S) + CLIENT_ID.encode())
+        return self.await_type(0x05)[2] == 0
+
+    def publish(self, payload, qos):
+        self.msg_id = self.msg_id % 0xFFFF + 1 if qos == 1 else 0
+        flags = {-1: 0x60, 0: 0x00, 1: 0x20}[qos] | 0x01
+        self.send(bytes([7 + len(payload), 0x0C, flags]) + struct.pack(">HH", TOPIC_ID, self.msg_id) + payload)
+        if qos == 1:
+            return self.await_type(0x0D)[6] == 0
+        return True
+
+    def sleep(self):
+        self.send(bytes([4, 0x18]) + struct.pack(">H", SLEEP_S))
+        self.await_type(0x18)
+
+
+def run_sn(args, counter, qos):
+    client = SnClient(args.gateway, args.gateway_port, counter)
+    before = counter.snapshot()
+    client.connect(clean=True)
+    client.sleep()
+    counter.exclude(before, counter.snapshot())
+    for i in range(args.readings):
+        started = time.perf_counter()
+        if qos == 1:
+            client.connect(clean=False)
+            client.publish(telemetry_payload(i), 1)
+            client.sleep()
+        else:
+            client.publish(telemetry_payload(i), -1)
+        counter.awake_s += time.perf_counter() - started
+        time.sleep(args.interval)
+
+
+# --- Harness ----------------------------------------------------------
+
+def count_delivered(args):
+    """Subscribes to the telemetry topic and counts what reaches the broker."""
+    received = {"n": 0}
+    sub = mqtt.Client(client_id="transport-compare-sub")
+    sub.on_message = lambda c, u, m: received.__setitem__("n", received["n"] + 1)
+    sub.connect(args.host, args.port)
+    sub.subscribe(TOPIC, qos=1)
+    sub.loop_start()
+    time.sleep(0.5)
+    return sub, received
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="localhost", help="MQTT broker")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--gateway", default="localhost", help="MQTT-SN gateway")
+    parser.add_argument("--gateway-port", type=int, default=10000)
+    parser.add_argument("--readings", type=int, default=200)
+    parser.add_argument("--interval", type=float, default=0.02, help="seconds between readings")
+    parser.add_argument("--scenarios", default="tcp,tcp-cycle,sn,sn-qos1")
+    args = parser.parse_args()
+
+    runners = {
+        "tcp": lambda c: run_tcp(args, c, cycle=False),
+        "tcp-cycle": lambda c: run_tcp(args, c, cycle=True),
+        "sn": lambda c: run_sn(args, c, qos=-1),
+        "sn-qos1": lambda c: run_sn(args, c, qos=1),
+    }
+
+    rows = []
+    for name in args.scenarios.split(","):
+        counter = Counter()
+        sub, received = count_delivered(args)
+        runners[name](counter)
+        time.sleep(1.0)
+        sub.loop_stop()
+        sub.disconnect()
+
+        n = args.readings
+        packets = counter.packets_out + counter.packets_in
+        if name.startswith("tcp"):
+            wire = counter.bytes_out + counter.bytes_in + counter.segments * TCP_IP_HEADER
+            wire_packets = counter.segments
+        else:
+            wire = counter.bytes_out + counter.bytes_in + packets * UDP_IP_HEADER
+            wire_packets = packets
+        rows.append((name, counter.bytes_out / n, counter.bytes_in / n, packets / n,
+                     wire / n, wire_packets / n, counter.awake_s * 1000 / n, received["n"]))
+
+    print(f"\n[Compare] {args.readings} readings per scenario")
+    print(f"{'scenario':<10} {'B out':>7} {'B in':>6} {'pkts':>5} {'wire B*':>8} {'wire pkts*':>10} "
+          f"{'awake ms':>9} {'delivered':>10}")
+    for name, out_b, in_b, pkts, wire, wire_pkts, awake, delivered in rows:
+        print(f"{name:<10} {out_b:7.1f} {in_b:6.1f} {pkts:5.2f} {wire:8.1f} {wire_pkts:10.2f} "
+              f"{awake:9.2f} {delivered:>5}/{args.readings}")
+    print("* estimated: IPv4 + TCP (40 B, one ACK per data segment, handshake/teardown) "
+          "or IPv4 + UDP (28 B) headers")
+    print("  tcp keeps the connection (and the radio) up between readings; awake ms is the exchange only")
+
+
+if __name__ == "__main__":
+    main()